@@ -0,0 +1,319 @@
+#include "Delaunay.h"
+#include "openmp.h"
+
+#include "delaunator/delaunator.hpp"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <unordered_map>
+
+using delaunator::INVALID_INDEX;
+
+static inline size_t next_halfedge(size_t e) { return (e % 3 == 2) ? e - 2 : e + 1; }
+static inline uint64_t edge_key(size_t a, size_t b) { return ((uint64_t)a << 32) | (uint64_t)b; }
+
+Delaunay::Delaunay(const std::vector<double>& coords, int ncpu)
+{
+  size_t n = coords.size()/2;
+  int nstrips = (int)std::min<size_t>(std::max(ncpu, 1), n / min_points_per_strip);
+
+  if (nstrips > 1 && n < std::numeric_limits<uint32_t>::max() && triangulate(coords, nstrips, ncpu))
+    return;
+
+  triangulate(coords);
+}
+
+void Delaunay::triangulate(const std::vector<double>& coords)
+{
+  delaunator::Delaunator d(coords);
+  triangles = std::move(d.triangles);
+  halfedges = std::move(d.halfedges);
+}
+
+bool Delaunay::triangulate(const std::vector<double>& coords, int nstrips, int ncpu)
+{
+  struct Strip
+  {
+    std::vector<size_t> ids;       // global index of the local points
+    std::vector<size_t> triangles; // local point indexes
+    std::vector<size_t> halfedges;
+    std::vector<size_t> newid;     // index of the triangle in the output or INVALID_INDEX if not final
+    size_t nfinal = 0;
+    bool ok = false;
+  };
+
+  size_t n = coords.size()/2;
+
+  double xmin = std::numeric_limits<double>::max();
+  double xmax = std::numeric_limits<double>::lowest();
+  std::vector<double> xs(n);
+  for (size_t i = 0 ; i < n ; i++)
+  {
+    xs[i] = coords[2*i];
+    xmin = std::min(xmin, xs[i]);
+    xmax = std::max(xmax, xs[i]);
+  }
+
+  // Circumcircles must be inside their strip by this margin to absorb the rounding errors
+  double margin = 1e-6 * (xmax - xmin);
+
+  // 1. Split the points into strips of equal count. Strip s contains x in [bounds[s], bounds[s+1])
+  std::vector<double> bounds(nstrips+1);
+  bounds[0] = std::numeric_limits<double>::lowest();
+  bounds[nstrips] = std::numeric_limits<double>::max();
+  auto first = xs.begin();
+  for (int s = 1 ; s < nstrips ; s++)
+  {
+    auto nth = xs.begin() + s*n/nstrips;
+    std::nth_element(first, nth, xs.end());
+    bounds[s] = *nth;
+    if (bounds[s] <= bounds[s-1]) return false;
+    first = nth;
+  }
+  xs.clear();
+  xs.shrink_to_fit();
+
+  std::vector<Strip> strips(nstrips);
+  for (size_t i = 0 ; i < n ; i++)
+  {
+    int s = std::upper_bound(bounds.begin()+1, bounds.end()-1, coords[2*i]) - (bounds.begin()+1);
+    strips[s].ids.push_back(i);
+  }
+
+  // 2. Triangulate the strips concurrently. Each point belongs to a single strip so each thread
+  // writes different elements of 'seam'
+  std::vector<char> seam(n, 0);
+
+  parallel_for(nstrips, ncpu, [&](int64_t s)
+  {
+    Strip& strip = strips[s];
+
+    std::vector<double> local(2*strip.ids.size());
+    for (size_t i = 0 ; i < strip.ids.size() ; i++)
+    {
+      local[2*i] = coords[2*strip.ids[i]];
+      local[2*i+1] = coords[2*strip.ids[i]+1];
+    }
+
+    try
+    {
+      delaunator::Delaunator d(local);
+      strip.triangles = std::move(d.triangles);
+      strip.halfedges = std::move(d.halfedges);
+
+      // The hull of the strip is not complete. Its vertices may have triangles in the other strips
+      size_t e = d.hull_start;
+      do { seam[strip.ids[e]] = 1; e = d.hull_next[e]; } while (e != d.hull_start);
+    }
+    catch (...)
+    {
+      return;
+    }
+
+    double lo = bounds[s] + margin;
+    double hi = bounds[s+1] - margin;
+
+    size_t ntri = strip.triangles.size()/3;
+    strip.newid.assign(ntri, INVALID_INDEX);
+    for (size_t t = 0 ; t < ntri ; t++)
+    {
+      const size_t* v = &strip.triangles[3*t];
+      double ax = local[2*v[0]], ay = local[2*v[0]+1];
+      double dx = local[2*v[1]] - ax, dy = local[2*v[1]+1] - ay;
+      double ex = local[2*v[2]] - ax, ey = local[2*v[2]+1] - ay;
+      double bl = dx*dx + dy*dy;
+      double cl = ex*ex + ey*ey;
+      double k = 0.5 / (dx*ey - dy*ex);
+      double cx = (ey*bl - dy*cl)*k;
+      double cy = (dx*cl - ex*bl)*k;
+      double r = std::sqrt(cx*cx + cy*cy);
+      cx += ax;
+
+      // Nothing outside the strip can be in the circumcircle: it is a triangle of the whole set
+      if (std::isfinite(r) && cx - r > lo && cx + r < hi)
+      {
+        strip.newid[t] = strip.nfinal++;
+      }
+      else
+      {
+        seam[strip.ids[v[0]]] = 1;
+        seam[strip.ids[v[1]]] = 1;
+        seam[strip.ids[v[2]]] = 1;
+      }
+    }
+
+    strip.ok = true;
+  });
+
+  size_t nfinal = 0;
+  for (auto& strip : strips)
+  {
+    if (!strip.ok) return false;
+    for (auto& id : strip.newid) if (id != INVALID_INDEX) id += nfinal;
+    nfinal += strip.nfinal;
+  }
+
+  // 3. Copy the final triangles with their halfedges. The halfedges toward a non final triangle
+  // are the boundary of the final area. They are recorded to be stitched with the seams
+  triangles.resize(3*nfinal);
+  halfedges.resize(3*nfinal);
+
+  std::vector<std::vector<std::pair<uint64_t, size_t>>> borders(nstrips);
+  parallel_for(nstrips, ncpu, [&](int64_t s)
+  {
+    Strip& strip = strips[s];
+    for (size_t t = 0 ; t < strip.newid.size() ; t++)
+    {
+      size_t id = strip.newid[t];
+      if (id == INVALID_INDEX) continue;
+
+      for (size_t j = 0 ; j < 3 ; j++)
+      {
+        size_t e = 3*t + j;
+        triangles[3*id + j] = strip.ids[strip.triangles[e]];
+
+        size_t twin = strip.halfedges[e];
+        if (twin != INVALID_INDEX && strip.newid[twin/3] != INVALID_INDEX)
+        {
+          halfedges[3*id + j] = 3*strip.newid[twin/3] + twin%3;
+        }
+        else
+        {
+          halfedges[3*id + j] = INVALID_INDEX;
+          size_t a = strip.ids[strip.triangles[e]];
+          size_t b = strip.ids[strip.triangles[next_halfedge(e)]];
+          borders[s].push_back({edge_key(a, b), 3*id + j});
+        }
+      }
+    }
+
+    strip.triangles.clear();
+    strip.triangles.shrink_to_fit();
+    strip.halfedges.clear();
+    strip.halfedges.shrink_to_fit();
+  });
+
+  std::unordered_map<uint64_t, size_t> border;
+  for (const auto& b : borders) border.insert(b.begin(), b.end());
+  borders.clear();
+
+  // 4. Triangulate the vertices of the seams and the hulls of the strips
+  std::vector<size_t> sids;
+  for (size_t i = 0 ; i < n ; i++) if (seam[i]) sids.push_back(i);
+  seam.clear();
+  seam.shrink_to_fit();
+
+  std::vector<double> local(2*sids.size());
+  for (size_t i = 0 ; i < sids.size() ; i++)
+  {
+    local[2*i] = coords[2*sids[i]];
+    local[2*i+1] = coords[2*sids[i]+1];
+  }
+
+  std::vector<size_t> stri;
+  std::vector<size_t> shalf;
+  try
+  {
+    delaunator::Delaunator d(local);
+    stri = std::move(d.triangles);
+    shalf = std::move(d.halfedges);
+  }
+  catch (...)
+  {
+    return false;
+  }
+
+  for (auto& v : stri) v = sids[v];
+
+  // 5. The seam triangulation covers the final area too. The boundary edges of the final area
+  // are edges of the seam triangulation. The triangle on the same side than the final triangle is
+  // in the final area, the other one is not. The labels are propagated to the triangles connected
+  // without crossing a boundary edge.
+  enum : char { UNKNOWN = 0, FINAL = 1, SEAM = 2 };
+  size_t nseam = stri.size()/3;
+  std::vector<char> label(nseam, UNKNOWN);
+  std::vector<char> is_border(stri.size(), 0);
+  for (size_t e = 0 ; e < stri.size() ; e++)
+  {
+    size_t a = stri[e];
+    size_t b = stri[next_halfedge(e)];
+
+    char l = UNKNOWN;
+    if (border.count(edge_key(a, b))) l = FINAL;
+    else if (border.count(edge_key(b, a))) l = SEAM;
+    if (l == UNKNOWN) continue;
+
+    is_border[e] = 1;
+    if (label[e/3] != UNKNOWN && label[e/3] != l) return false;
+    label[e/3] = l;
+  }
+
+  std::vector<size_t> stack;
+  for (size_t t = 0 ; t < nseam ; t++)
+  {
+    if (label[t] == UNKNOWN) continue;
+
+    stack.push_back(t);
+    while (!stack.empty())
+    {
+      size_t u = stack.back();
+      stack.pop_back();
+      for (size_t e = 3*u ; e < 3*u+3 ; e++)
+      {
+        size_t twin = shalf[e];
+        if (twin == INVALID_INDEX || is_border[e]) continue;
+        size_t v = twin/3;
+        if (label[v] == UNKNOWN) { label[v] = label[u]; stack.push_back(v); }
+        else if (label[v] != label[u]) return false;
+      }
+    }
+  }
+
+  // 6. Append the seam triangles and stitch them to the final triangles
+  std::vector<size_t> newid(nseam, INVALID_INDEX);
+  size_t id = nfinal;
+  for (size_t t = 0 ; t < nseam ; t++) if (label[t] != FINAL) newid[t] = id++;
+
+  triangles.resize(3*id);
+  halfedges.resize(3*id);
+  for (size_t t = 0 ; t < nseam ; t++)
+  {
+    if (newid[t] == INVALID_INDEX) continue;
+
+    for (size_t j = 0 ; j < 3 ; j++)
+    {
+      size_t e = 3*t + j;
+      size_t h = 3*newid[t] + j;
+      triangles[h] = stri[e];
+
+      size_t twin = shalf[e];
+      if (twin == INVALID_INDEX)
+      {
+        halfedges[h] = INVALID_INDEX;
+      }
+      else if (newid[twin/3] != INVALID_INDEX)
+      {
+        halfedges[h] = 3*newid[twin/3] + twin%3;
+      }
+      else
+      {
+        auto it = border.find(edge_key(stri[next_halfedge(e)], stri[e]));
+        if (it == border.end() || halfedges[it->second] != INVALID_INDEX) return false;
+        halfedges[h] = it->second;
+        halfedges[it->second] = h;
+      }
+    }
+  }
+
+  // 7. Check that the result is a triangulation of the convex hull. The hull of the seams is the
+  // hull of all the points. Euler's formula: ntriangles = 2*nvertices - 2 - nhull
+  size_t nhull = std::count(shalf.begin(), shalf.end(), INVALID_INDEX);
+  size_t nopen = std::count(halfedges.begin(), halfedges.end(), INVALID_INDEX);
+
+  std::vector<char> used(n, 0);
+  for (auto v : triangles) used[v] = 1;
+  size_t nvertices = std::count(used.begin(), used.end(), 1);
+
+  return nopen == nhull && id + 2 + nhull == 2*nvertices;
+}
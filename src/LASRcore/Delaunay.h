@@ -0,0 +1,31 @@
+#ifndef DELAUNAY_H
+#define DELAUNAY_H
+
+#include <vector>
+#include <cstddef>
+
+// Delaunay triangulation of 2D points stored as [x0, y0, x1, y1, ...]. It exposes the 'triangles'
+// and 'halfedges' arrays of delaunator with the same meaning. With several cores the points are
+// split into vertical strips of equal count that are triangulated concurrently. A triangle whose
+// circumcircle lies inside its strip is a Delaunay triangle of the whole set. The vertices of the
+// other triangles (the seams) are triangulated again and the seams are stitched to the strips.
+// The triangles are the same as the sequential triangulation but not in the same order. If the
+// stitching is not a valid triangulation (e.g. cocircular points on a seam) it falls back to the
+// sequential triangulation.
+class Delaunay
+{
+public:
+  Delaunay(const std::vector<double>& coords, int ncpu = 1);
+
+public:
+  std::vector<size_t> triangles;
+  std::vector<size_t> halfedges;
+
+  static constexpr size_t min_points_per_strip = 50000;
+
+private:
+  void triangulate(const std::vector<double>& coords);
+  bool triangulate(const std::vector<double>& coords, int nstrips, int ncpu);
+};
+
+#endif
@@ -14,6 +14,7 @@
 #include <sstream>
 #include <iomanip>
 #include <algorithm>
+#include <numeric>
 #include <filesystem>
 
 // To parse JSON VPC
@@ -574,21 +575,139 @@ bool FileCollection::set_chunk_size(double size)
 
     chunk_size = size;
 
+    // A regular grid of chunk_size defines the number of chunks. Cells that do not overlap
+    // any file are not counted.
+    int nchunks = 0;
     Grid grid(xmin, ymin, xmax, ymax, chunk_size);
     for (int i = 0 ; i < grid.get_ncells() ; i++)
     {
       double x = grid.x_from_cell(i);
       double y = grid.y_from_cell(i);
       double hsize = size/2;
-
-      if (file_index.has_overlap(x-hsize, y-hsize, x+hsize, y+hsize))
-        add_query(x-hsize, y-hsize, x+hsize, y+hsize);
+      if (file_index.has_overlap(x-hsize, y-hsize, x+hsize, y+hsize)) nchunks++;
     }
+
+    // But the chunks are not regular. The point density is far from being uniform and a regular grid
+    // produces chunks with very different number of points. Instead we split the extent of the collection
+    // into chunks that contain the same number of points, according to the distribution estimated
+    // from the headers and the spatial indexes.
+    std::vector<Rectangle> cells;
+    std::vector<uint64_t> counts;
+    get_point_distribution(cells, counts);
+
+    std::vector<int> indexes(cells.size());
+    std::iota(indexes.begin(), indexes.end(), 0);
+
+    Rectangle extent(xmin, ymin, xmax, ymax);
+    split_chunks(extent, nchunks, cells, counts, indexes);
   }
 
   return true;
 }
 
+// Estimates the spatial distribution of the points. For each file we use the cells of the quadtree
+// stored in the spatial index (lax file) with their number of points. For non indexed files the
+// points are assumed to be uniformly distributed in the bounding box of the file.
+void FileCollection::get_point_distribution(std::vector<Rectangle>& cells, std::vector<uint64_t>& counts) const
+{
+  for (size_t i = 0 ; i < headers.size() ; i++)
+  {
+    const Header& h = headers[i];
+
+    bool lax = false;
+    if (h.spatial_index && h.signature == "LASF")
+    {
+      LASio reader;
+      if (reader.open(files[i].string()))
+      {
+        lax = reader.get_index_cells(cells, counts);
+        reader.close();
+      }
+    }
+
+    if (!lax)
+    {
+      cells.emplace_back(h.min_x, h.min_y, h.max_x, h.max_y);
+      counts.push_back(h.number_of_point_records);
+    }
+  }
+}
+
+// Estimated number of points in a rectangle assuming uniform distribution of the points in each cell
+static double estimate_count(const Rectangle& rect, const std::vector<Rectangle>& cells, const std::vector<uint64_t>& counts, const std::vector<int>& indexes)
+{
+  const double epsilon = 1e-6;
+
+  double n = 0;
+  for (int i : indexes)
+  {
+    const Rectangle& c = cells[i];
+    double w = MAX(c.maxx - c.minx, epsilon);
+    double h = MAX(c.maxy - c.miny, epsilon);
+    double dx = MIN(rect.maxx, c.minx + w) - MAX(rect.minx, c.minx);
+    double dy = MIN(rect.maxy, c.miny + h) - MAX(rect.miny, c.miny);
+    if (dx <= 0 || dy <= 0) continue;
+    n += counts[i] * (dx/w) * (dy/h);
+  }
+
+  return n;
+}
+
+// Recursive binary space partition. The rectangle is split in two along its longest side at the position
+// that balances the number of points such as we get k chunks of similar number of points.
+void FileCollection::split_chunks(const Rectangle& rect, int k, const std::vector<Rectangle>& cells, const std::vector<uint64_t>& counts, const std::vector<int>& indexes)
+{
+  double n = estimate_count(rect, cells, counts, indexes);
+  if (n <= 0) return;
+
+  // Do not produce tiny chunks. The buffer would be larger than the chunk itself.
+  double w = rect.maxx - rect.minx;
+  double h = rect.maxy - rect.miny;
+  if (k <= 1 || MAX(w, h) < chunk_size/4)
+  {
+    add_query(rect.minx, rect.miny, rect.maxx, rect.maxy);
+    return;
+  }
+
+  // Only the cells that overlap this rectangle are useful for the next levels
+  std::vector<int> subset;
+  for (int i : indexes)
+  {
+    const Rectangle& c = cells[i];
+    if (c.maxx >= rect.minx && c.minx <= rect.maxx && c.maxy >= rect.miny && c.miny <= rect.maxy)
+      subset.push_back(i);
+  }
+
+  int k1 = k/2;
+  int k2 = k - k1;
+  double target = n * (double)k1 / (double)k;
+  bool vertical = w >= h;
+
+  // Bisection to find the cut
+  double lo = (vertical) ? rect.minx : rect.miny;
+  double hi = (vertical) ? rect.maxx : rect.maxy;
+  for (int iter = 0 ; iter < 30 ; iter++)
+  {
+    double mid = (lo+hi)/2;
+    Rectangle left = (vertical) ? Rectangle(rect.minx, rect.miny, mid, rect.maxy) : Rectangle(rect.minx, rect.miny, rect.maxx, mid);
+    if (estimate_count(left, cells, counts, subset) < target) lo = mid; else hi = mid;
+  }
+
+  // Round the cut to the millimeter to get clean chunk limits
+  double cut = std::round((lo+hi)/2*1000)/1000;
+
+  if (vertical)
+  {
+    split_chunks(Rectangle(rect.minx, rect.miny, cut, rect.maxy), k1, cells, counts, subset);
+    split_chunks(Rectangle(cut, rect.miny, rect.maxx, rect.maxy), k2, cells, counts, subset);
+  }
+  else
+  {
+    split_chunks(Rectangle(rect.minx, rect.miny, rect.maxx, cut), k1, cells, counts, subset);
+    split_chunks(Rectangle(rect.minx, cut, rect.maxx, rect.maxy), k2, cells, counts, subset);
+  }
+}
+
 bool FileCollection::get_chunk(int i, Chunk& chunk) const
 {
   if (i < 0 || i > get_number_chunks())
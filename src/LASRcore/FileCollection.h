@@ -71,6 +71,8 @@ private:
   bool add_header(const Header& header, bool noprocess = false);
   bool get_chunk_regular(int index, Chunk& chunk) const;
   bool get_chunk_with_query(int index, Chunk& chunk) const;
+  void get_point_distribution(std::vector<Rectangle>& cells, std::vector<uint64_t>& counts) const;
+  void split_chunks(const Rectangle& rect, int k, const std::vector<Rectangle>& cells, const std::vector<uint64_t>& counts, const std::vector<int>& indexes);
   PathType parse_path(const std::string& path);
 
 private:
@@ -1,6 +1,12 @@
 #include "GDALdataset.h"
 #include "NA.h"
 
+#include "print.h"
+
+#include <gdal_utils.h>
+#include <cstdio>
+#include <functional>
+
 bool GDALdataset::initialized = false;
 
 GDALdataset::GDALdataset()
@@ -24,6 +30,8 @@ GDALdataset::GDALdataset()
   eGType = wkbUnknown;
   eType = GDT_Float32;
   dType = GDALDatasetType::UNDEFINED;
+
+  cog = false;
 }
 
 /*GDALdataset::GDALdataset(const GDALdataset& other)
@@ -164,18 +172,59 @@ bool GDALdataset::create_file()
     // # nocov end
   }
 
-  // Writing options (compression and co)
-  char** papszOptions = NULL;
-  if (strcmp(driver->GetDescription(), "GTiff") == 0)
+  bool gtiff = strcmp(driver->GetDescription(), "GTiff") == 0;
+
+  // Writing options (compression and co). The options given by the user override the defaults
+  std::map<std::string, std::string> options;
+  if (gtiff)
   {
-    papszOptions = CSLSetNameValue(papszOptions, "COMPRESS", "ZSTD");
-    papszOptions = CSLSetNameValue(papszOptions, "PREDICTOR", "3");
-    papszOptions = CSLSetNameValue(papszOptions, "ZSTD_LEVEL", "9");
-    papszOptions = CSLSetNameValue(papszOptions, "TILED", "YES");
-    papszOptions = CSLSetNameValue(papszOptions, "BIGTIFF", "IF_SAFER");
+    options = {{"COMPRESS", "ZSTD"}, {"PREDICTOR", "3"}, {"ZSTD_LEVEL", "9"}, {"TILED", "YES"}, {"BIGTIFF", "IF_SAFER"}};
+    if (creation_options.count("COMPRESS"))
+    {
+      options.erase("PREDICTOR");
+      options.erase("ZSTD_LEVEL");
+    }
   }
+  for (const auto& [key, value] : creation_options) options[key] = value;
+
+  // A COG cannot be written block by block. The data are written in a temporary GeoTIFF quickly
+  // compressed that is translated into a COG by the COG driver when the dataset is closed i.e.
+  // when the last owner of the dataset is destroyed.
+  std::string dst = file;
+  std::function<void(GDALDataset*)> close = GDALClose;
+  if (cog && gtiff && is_raster())
+  {
+    std::map<std::string, std::string> cog_options = options;
+    cog_options.erase("TILED");
+    cog_options.erase("BLOCKXSIZE");
+    cog_options.erase("BLOCKYSIZE");
+    for (const char* level : {"ZSTD_LEVEL", "ZLEVEL"})
+    {
+      if (!cog_options.count(level)) continue;
+      cog_options["LEVEL"] = cog_options[level];
+      cog_options.erase(level);
+    }
+    if (!cog_options.count("OVERVIEWS")) cog_options["OVERVIEWS"] = "AUTO";
 
-  dataset.reset(driver->Create(file.c_str(), nXsize, nYsize, nBands, eType, papszOptions), GDALClose);
+    std::map<std::string, std::string> tmp_options = {{"COMPRESS", "ZSTD"}, {"ZSTD_LEVEL", "1"}, {"TILED", "YES"}, {"BIGTIFF", "IF_SAFER"}};
+    if (options.count("NUM_THREADS")) tmp_options["NUM_THREADS"] = options["NUM_THREADS"];
+    options.swap(tmp_options);
+
+    dst = file + ".tmp";
+    close = [src = dst, cog_file = file, cog_options](GDALDataset* d)
+    {
+      GDALClose(d);
+      if (!translate_to_cog(src, cog_file, cog_options)) warning("%s\n", last_error.c_str()); // # nocov
+    };
+  }
+
+  char** papszOptions = NULL;
+  for (const auto& [key, value] : options) papszOptions = CSLSetNameValue(papszOptions, key.c_str(), value.c_str());
+
+  GDALDataset* d = driver->Create(dst.c_str(), nXsize, nYsize, nBands, eType, papszOptions);
+  if (d) dataset.reset(d, close);
+
+  CSLDestroy(papszOptions);
 
   if (!dataset)
   {
@@ -328,6 +377,69 @@ void GDALdataset::initialize_gdal()
   }
 }
 
+void GDALdataset::set_creation_options(const std::map<std::string, std::string>& options, bool cog)
+{
+  creation_options = options;
+  this->cog = cog;
+}
+
+// Copy a raster file into a cloud optimized GeoTIFF with overviews and remove the source file
+bool GDALdataset::translate_to_cog(const std::string& src, const std::string& dst, const std::map<std::string, std::string>& options)
+{
+  GDALDriver* driver = GetGDALDriverManager()->GetDriverByName("COG");
+  if (!driver)
+  {
+    last_error = "no suitable GDAL driver found with name 'COG'. GDAL >= 3.1 is required to write COGs. The file was written in " + src; // # nocov
+    return false; // # nocov
+  }
+
+  GDALDataset* source = (GDALDataset*)GDALOpen(src.c_str(), GA_ReadOnly);
+  if (!source)
+  {
+    last_error = "cannot open " + src + ". " + std::string(CPLGetLastErrorMsg()); // # nocov
+    return false; // # nocov
+  }
+
+  char** papszOptions = NULL;
+  for (const auto& [key, value] : options) papszOptions = CSLSetNameValue(papszOptions, key.c_str(), value.c_str());
+  GDALDataset* copy = driver->CreateCopy(dst.c_str(), source, FALSE, papszOptions, NULL, NULL);
+  CSLDestroy(papszOptions);
+  GDALClose(source);
+
+  if (!copy)
+  {
+    last_error = "error while writing the COG " + dst + ". " + std::string(CPLGetLastErrorMsg()) + " The file was written in " + src; // # nocov
+    return false; // # nocov
+  }
+
+  GDALClose(copy);
+  std::remove(src.c_str());
+  return true;
+}
+
+// Assemble some raster files into a single virtual raster (VRT). The files must be closed.
+bool GDALdataset::build_vrt(const std::vector<std::string>& files, const std::string& vrt)
+{
+  std::vector<const char*> names;
+  names.reserve(files.size());
+  for (const auto& f : files) names.push_back(f.c_str());
+
+  int error = 0;
+  GDALBuildVRTOptions* options = GDALBuildVRTOptionsNew(NULL, NULL);
+  GDALDatasetH hdataset = GDALBuildVRT(vrt.c_str(), names.size(), NULL, names.data(), options, &error);
+  GDALBuildVRTOptionsFree(options);
+
+  if (hdataset == NULL || error)
+  {
+    last_error = "error while building the virtual raster " + vrt + ". " + std::string(CPLGetLastErrorMsg()); // # nocov
+    if (hdataset) GDALClose(hdataset); // # nocov
+    return false; // # nocov
+  }
+
+  GDALClose(hdataset);
+  return true;
+}
+
 const std::map<std::string, std::string> GDALdataset::extension2driver = {
   {"bna", "BNA"}, // Vector
   {"csv", "CSV"},
@@ -24,11 +24,14 @@ public:
   bool set_nbands(int nbands);
   bool set_band_name(std::string name, int band);
   bool set_crs(const CRS& crs);
+  void set_creation_options(const std::map<std::string, std::string>& options, bool cog);
   bool is_raster() const { return dType == GDALDatasetType::RASTER; }
   bool is_vector() const { return dType == GDALDatasetType::VECTOR; }
 
   enum warnings { DUPFID };
   static void initialize_gdal();
+  static bool build_vrt(const std::vector<std::string>& files, const std::string& vrt);
+  static bool translate_to_cog(const std::string& src, const std::string& dst, const std::map<std::string, std::string>& options);
   static const std::map<std::string, std::string> extension2driver;
 
 protected:
@@ -48,6 +51,9 @@ protected:
   std::string file;
   std::vector<std::string> band_names;
 
+  std::map<std::string, std::string> creation_options; // User defined GDAL creation options
+  bool cog;                                            // Cloud optimized GeoTIFF
+
   GDALDatasetType dType;    // The type of dataset (vector or raster or undefined)
   GDALDataType eType;       // The type of data in the dataset for rasters (is GDT_Float32)
   OGRSpatialReference oSRS;
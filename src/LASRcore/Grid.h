@@ -6,33 +6,6 @@
 #include <cmath>
 #include <vector>
 
-struct Voxel
-{
-  int i, j, k;
-  Voxel() : i(0), j(0), k(0) {}
-  Voxel(int i, int j, int k) : i(i), j(j), k(k) {}
-  size_t hash() const
-  {
-    // Create individual hashes for x and y
-    size_t hashi = std::hash<int>{}(i);
-    size_t hashj = std::hash<int>{}(j);
-    size_t hashk = std::hash<int>{}(k);
-
-    // Combine the individual hashes using a hash combiner
-    size_t seed = 0;
-    seed ^= hashi + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-    seed ^= hashj + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-    seed ^= hashk + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-    return seed;
-  };
-  bool operator==(const Voxel& other) const { return i == other.i && j == other.j && k == other.k; };
-};
-
-struct VoxelHash
-{
-  std::size_t operator()(const Voxel& voxel) const { return voxel.hash() ;}
-};
-
 class Grid
 {
 public:
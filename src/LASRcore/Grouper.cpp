@@ -89,4 +89,78 @@ void Grouper::clear()
 {
   map.clear();
   npoints = 0;
-}
\ No newline at end of file
+}
+
+CellGrouper::CellGrouper()
+{
+}
+
+void CellGrouper::insert(int index, int key)
+{
+  keys.push_back(key);
+  points.push_back(index);
+}
+
+void CellGrouper::insert(int index, const std::vector<int>& keys)
+{
+  for (int key : keys) insert(index, key);
+}
+
+void CellGrouper::group(int ncells)
+{
+  // Count the points per cell. Keys outside the grid are dropped
+  offsets.assign((size_t)ncells+1, 0);
+  for (int key : keys)
+  {
+    if (key >= 0 && key < ncells) offsets[key+1]++;
+  }
+
+  // Prefix sum: offsets[k] is the position of the first point of cell k
+  cells.clear();
+  for (int k = 0 ; k < ncells ; k++)
+  {
+    if (offsets[k+1] > 0) cells.push_back(k);
+    offsets[k+1] += offsets[k];
+  }
+
+  // Scatter the points. Insertion order is preserved within a cell
+  indexes.resize(offsets[ncells]);
+  std::vector<int> cursor(offsets.begin(), offsets.end()-1);
+  for (size_t i = 0 ; i < keys.size() ; i++)
+  {
+    int key = keys[i];
+    if (key >= 0 && key < ncells) indexes[cursor[key]++] = points[i];
+  }
+
+  // The pairs are no longer needed
+  keys.clear();
+  keys.shrink_to_fit();
+  points.clear();
+  points.shrink_to_fit();
+}
+
+int CellGrouper::largest_group_size() const
+{
+  int max = 0;
+  for (int cell : cells)
+  {
+    int n = offsets[cell+1] - offsets[cell];
+    if (n > max) max = n;
+  }
+
+  return max;
+}
+
+void CellGrouper::clear()
+{
+  keys.clear();
+  keys.shrink_to_fit();
+  points.clear();
+  points.shrink_to_fit();
+  indexes.clear();
+  indexes.shrink_to_fit();
+  offsets.clear();
+  offsets.shrink_to_fit();
+  cells.clear();
+  cells.shrink_to_fit();
+}
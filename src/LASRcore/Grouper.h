@@ -4,6 +4,7 @@
 #include "Interval.h"
 
 #include <vector>
+#include <cstddef>
 #include <unordered_map>
 
 class Grouper
@@ -21,4 +22,31 @@ public:
   std::unordered_map<int, std::vector<Interval>> map;
 };
 
+// Groups the point indexes by cell of a grid of known size with a counting sort. The indexes of
+// the points of a group are stored contiguously in a single flat array. It does not allocate memory
+// per group and the groups are visited in cell order. A point may belong to several groups (moving
+// windows). Usage: insert() every point, then group() once, then query the groups by rank.
+class CellGrouper
+{
+public:
+  CellGrouper();
+  void insert(int index, int key);
+  void insert(int index, const std::vector<int>& keys);
+  void group(int ncells);
+  void clear();
+  int largest_group_size() const;
+
+  size_t size() const { return cells.size(); }
+  int get_key(size_t i) const { return cells[i]; }
+  const int* begin(size_t i) const { return indexes.data() + offsets[cells[i]]; }
+  const int* end(size_t i) const { return indexes.data() + offsets[cells[i]+1]; }
+
+private:
+  std::vector<int> keys;      // cell id of each inserted (point, cell) pair
+  std::vector<int> points;    // point index of each inserted (point, cell) pair
+  std::vector<int> indexes;   // point indexes sorted by cell
+  std::vector<int> offsets;   // position of the first point of each cell in 'indexes'
+  std::vector<int> cells;     // non empty cells
+};
+
 #endif
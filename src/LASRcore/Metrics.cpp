@@ -10,50 +10,106 @@
 
 bool MetricManager::parse(const std::vector<std::string>& names, bool support_streamable)
 {
+  this->names.clear();
   streaming_operators.clear();
   regular_operators.clear();
+  columns.clear();
+  moment_accessors.clear();
+  sketch_accessors.clear();
+  clear_accumulators();
+  n_moments = 0;
+  n_counters = 0;
+  n_sketches = 0;
 
   if (names.size() == 0) return true;
 
-  // Check if we have only streamable MetricManager
-  if (support_streamable)
+  try
   {
-    streamable = true;
+    // Regular metrics can always be computed on a group of points
     for (const auto& name : names)
     {
-      if (name != "max" && name != "min" && name != "count" && name != "z_max" && name != "z_min")
+      regular_operators.push_back(parse(name));
+      this->names.push_back(name);
+    }
+
+    // Check if we have only streamable metrics
+    if (support_streamable)
+    {
+      streamable = true;
+      for (const auto& name : names)
       {
-        streamable = false;
-        break;
+        std::string attribute, metric;
+        float param;
+        parse(name, attribute, metric, param);
+        if (streamable_metrics.find(metric) == streamable_metrics.end())
+        {
+          streamable = false;
+          break;
+        }
       }
     }
-  }
 
-  // If we have only streamable MetricManager
-  if (streamable)
-  {
-    for (const auto& name : names)
+    // If we have only streamable metrics
+    if (streamable)
     {
-      if (name == "max" || name == "z_max")
-        streaming_operators.push_back(&MetricManager::pmax);
-      else if (name == "min" || name == "z_min")
-        streaming_operators.push_back(&MetricManager::pmin);
-      else if (name == "count")
-        streaming_operators.push_back(&MetricManager::pcount);
-
-      this->names.push_back(name);
-    }
+      std::vector<std::string> attributes;
+      std::vector<std::string> sketched_attributes;
 
-    return true;
-  }
+      for (const auto& name : names)
+      {
+        std::string attribute, metric;
+        float param;
+        parse(name, attribute, metric, param);
+
+        StreamingOperator op;
+        op.fold = nullptr;
+        op.finalize = nullptr;
+        op.accessor = AttributeAccessor(attribute);
+        op.param = param;
+        op.moment = -1;
+        op.counter = -1;
+        op.sketch = -1;
+
+        if (metric == "max")
+          op.fold = &MetricManager::pmax;
+        else if (metric == "min")
+          op.fold = &MetricManager::pmin;
+        else if (metric == "count")
+          op.fold = &MetricManager::pcount;
+        else
+        {
+          op.finalize = streamable_metrics.at(metric);
+
+          // The moments are shared by all the metrics derived from the same attribute
+          auto it = std::find(attributes.begin(), attributes.end(), attribute);
+          op.moment = std::distance(attributes.begin(), it);
+          if (it == attributes.end())
+          {
+            attributes.push_back(attribute);
+            moment_accessors.push_back(AttributeAccessor(attribute));
+          }
+
+          if (metric == "above")
+            op.counter = n_counters++;
+
+          // The sketches are shared by all the percentiles of the same attribute
+          if (metric == "p~" || metric == "median~")
+          {
+            auto it = std::find(sketched_attributes.begin(), sketched_attributes.end(), attribute);
+            op.sketch = std::distance(sketched_attributes.begin(), it);
+            if (it == sketched_attributes.end())
+            {
+              sketched_attributes.push_back(attribute);
+              sketch_accessors.push_back(AttributeAccessor(attribute));
+            }
+          }
+        }
+
+        streaming_operators.push_back(op);
+      }
 
-  // Regular case including non streamable MetricManager
-  try
-  {
-    for (const auto& name : names)
-    {
-      regular_operators.push_back(parse(name));
-      this->names.push_back(name);
+      n_moments = attributes.size();
+      n_sketches = sketched_attributes.size();
     }
   }
   catch(std::exception& e)
@@ -65,27 +121,31 @@ bool MetricManager::parse(const std::vector<std::string>& names, bool support_st
   return true;
 }
 
-MetricCalculator MetricManager::parse(const std::string& name)
+void MetricManager::parse(const std::string& name, std::string& attribute, std::string& metric, float& param)
 {
   // name is in the format attribute_functionXX where attribute is an attribute of the points
-  // function is a function to apply and XX an optional parameter. We first parse the string
+  // function is a function to apply and XX an optional parameter. A trailing ~ requests an
+  // approximate percentile that can be streamed.
 
-  float param = 0;
-  std::string metric;
-  std::string attribute;
+  param = 0;
 
-  std::string::size_type underscore_pos = name.find('_');
+  bool approximate = !name.empty() && name.back() == '~';
+  std::string base = (approximate) ? name.substr(0, name.size()-1) : name;
+
+  std::string::size_type underscore_pos = base.find('_');
   if (underscore_pos == std::string::npos)
   {
     attribute = "Z";
-    metric = name;
+    metric = base;
   }
   else
   {
-    attribute = name.substr(0, underscore_pos);
-    metric = name.substr(underscore_pos + 1);
+    attribute = base.substr(0, underscore_pos);
+    metric = base.substr(underscore_pos + 1);
   }
 
+  if (metric.empty()) throw std::invalid_argument("Invalid metric name: " + name);
+
   if (metric[0] == 'p')
   {
     std::string probs = metric.substr(1);
@@ -106,14 +166,97 @@ MetricCalculator MetricManager::parse(const std::string& name)
     metric = metric.substr(0,5);
   }
 
-  // The string is parsed. We can instantiate the accessors
-  auto it1 = metric_functions.find(metric);
-  if (it1 == metric_functions.end()) throw std::invalid_argument("Invalid metric name: " + metric);
+  if (approximate)
+  {
+    if (metric != "p" && metric != "median") throw std::invalid_argument("Only percentiles can be approximated with '~' in: " + name);
+    if (metric == "median") param = 50;
+    metric += "~";
+  }
+
+  if (metric_functions.find(metric) == metric_functions.end()) throw std::invalid_argument("Invalid metric name: " + metric);
 
   attribute = map_attribute(attribute);
-  AttributeAccessor attribute_accessor(attribute);
+}
+
+MetricCalculator MetricManager::parse(const std::string& name)
+{
+  float param;
+  std::string metric;
+  std::string attribute;
+  parse(name, attribute, metric, param);
+
+  // The string is parsed. All the metrics of an attribute share the same column
+  auto it = std::find_if(columns.begin(), columns.end(), [&attribute](const AttributeColumn& c) { return c.name == attribute; });
+  int column = std::distance(columns.begin(), it);
+  if (it == columns.end()) columns.emplace_back(attribute);
+
+  AttributeColumn& c = columns[column];
+  if (metric == "median" || metric == "p" || metric == "mode" || metric == "median~" || metric == "p~") c.need_sort = true;
+  if (metric == "sd" || metric == "cv" || metric == "skew" || metric == "kurt") c.need_moments = true;
+
+  return MetricCalculator(metric_functions.at(metric), column, param);
+}
+
+// The loops run on contiguous arrays of double without branches and are vectorized
+void AttributeColumn::compute(const PointCollection& points)
+{
+  accessor(points, values);
+
+  const double* x = values.data();
+  const size_t n = values.size();
+
+  double vmin = std::numeric_limits<double>::max();
+  double vmax = std::numeric_limits<double>::lowest();
+  double vsum = 0;
 
-  return MetricCalculator(it1->second, attribute_accessor, param);
+  #pragma omp simd reduction(min:vmin) reduction(max:vmax) reduction(+:vsum)
+  for (size_t i = 0 ; i < n ; i++)
+  {
+    vmin = (x[i] < vmin) ? x[i] : vmin;
+    vmax = (x[i] > vmax) ? x[i] : vmax;
+    vsum += x[i];
+  }
+
+  min = vmin;
+  max = vmax;
+  sum = vsum;
+  first = x[0];
+
+  if (need_moments)
+  {
+    const double mean = sum/n;
+    double s2 = 0, s3 = 0, s4 = 0;
+
+    #pragma omp simd reduction(+:s2,s3,s4)
+    for (size_t i = 0 ; i < n ; i++)
+    {
+      double d = x[i] - mean;
+      double d2 = d*d;
+      s2 += d2;
+      s3 += d2*d;
+      s4 += d2*d2;
+    }
+
+    m2 = s2;
+    m3 = s3;
+    m4 = s4;
+  }
+
+  if (need_sort) std::sort(values.begin(), values.end());
+}
+
+void MomentAccumulator::add(double x)
+{
+  double n1 = n;
+  n++;
+  double delta = x - mean;
+  double delta_n = delta / n;
+  double delta_n2 = delta_n * delta_n;
+  double term1 = delta * delta_n * n1;
+  mean += delta_n;
+  m4 += term1 * delta_n2 * ((double)n*n - 3.0*n + 3) + 6 * delta_n2 * m2 - 4 * delta_n * m3;
+  m3 += term1 * delta_n * (n - 2.0) - 3 * delta_n * m2;
+  m2 += term1;
 }
 
 // streamable MetricManager
@@ -121,178 +264,231 @@ float MetricManager::pmax  (float x, float y) const { if (x == NA_F32_RASTER) re
 float MetricManager::pmin  (float x, float y) const { if (x == NA_F32_RASTER) return y; return (x < y) ? x : y; }
 float MetricManager::pcount(float x, float y) const { if (x == NA_F32_RASTER) return 1; return x+1; }
 
-// batch MetricManager
+// Same definitions than the batch metrics
+float MetricManager::pmean (const StreamingOperator& op, int cell) const { return (float)get_moments(op, cell).mean; }
+float MetricManager::psum  (const StreamingOperator& op, int cell) const { const auto& acc = get_moments(op, cell); return (float)(acc.mean*acc.n); }
 
-float MetricManager::min(AttributeAccessor& accessor, const PointCollection& points, float param) const
+float MetricManager::psd(const StreamingOperator& op, int cell) const
 {
-  double min = std::numeric_limits<double>::max();
-  for (const auto& point : points)
-  {
-    double val = accessor(&point);
-    if (min > val) min = val;
-  }
-  return min;
+  const auto& acc = get_moments(op, cell);
+  if (acc.n < 2) return NA_F32_RASTER;
+  return (float)std::sqrt(acc.m2/(acc.n-1));
 }
 
-float MetricManager::max(AttributeAccessor& accessor, const PointCollection& points, float param) const
+float MetricManager::pcv(const StreamingOperator& op, int cell) const
 {
-  double max = std::numeric_limits<double>::lowest();
-  for (const auto& point : points)
-  {
-    double val = accessor(&point);
-    if (max < val) max = val;
-  }
-  return max;
+  float avg = pmean(op, cell);
+  float std = psd(op, cell);
+  if (avg == 0 || avg == NA_F32_RASTER || std == NA_F32_RASTER) return NA_F32_RASTER;
+  return std/avg;
 }
 
-float MetricManager::mean(AttributeAccessor& accessor, const PointCollection& points, float param) const
+float MetricManager::pskew(const StreamingOperator& op, int cell) const
 {
-  double sum = 0.0;
-  for (const auto& point : points) sum += accessor(&point);
-  return (float)(sum/points.size());
+  const auto& acc = get_moments(op, cell);
+  if (acc.n < 2) return NA_F32_RASTER;
+  return (float)((acc.m3/acc.n) / std::pow(acc.m2/acc.n, 1.5));
 }
 
-float MetricManager::median(AttributeAccessor& accessor, const PointCollection& points, float param) const
+float MetricManager::pkurt(const StreamingOperator& op, int cell) const
 {
-  std::vector<double> x;
-  x.reserve(points.size());
-  for (const auto& point : points) x.push_back(accessor(&point));
-  std::sort(x.begin(), x.end());
-  return percentile(x, 50);
+  const auto& acc = get_moments(op, cell);
+  if (acc.n < 2) return NA_F32_RASTER;
+  return (float)((acc.m4/acc.n) / std::pow(acc.m2/acc.n, 2));
 }
 
-float MetricManager::sd(AttributeAccessor& accessor, const PointCollection& points, float param) const
+float MetricManager::pabove(const StreamingOperator& op, int cell) const
 {
-  if (points.size() < 2) return NA_F32_RASTER;
+  uint32_t k = counters[(size_t)cell*n_counters + op.counter];
+  return (float)k/(float)get_moments(op, cell).n;
+}
 
-  double sum = 0.0;
-  for (const auto& point : points) sum += accessor(&point);
-  double mean = sum/points.size();
+float MetricManager::pquantile(const StreamingOperator& op, int cell) const
+{
+  const TDigest& digest = sketches[(size_t)cell*n_sketches + op.sketch];
+  return (float)digest.quantile(op.param/100);
+}
 
-  sum = 0.0;
-  for (const auto& point : points)
-  {
-    double value = accessor(&point);
-    sum += (value - mean) * (value - mean);
-  }
+// batch MetricManager
+
+float MetricManager::min(const AttributeColumn& c, float param) { return (float)c.min; }
+float MetricManager::max(const AttributeColumn& c, float param) { return (float)c.max; }
+float MetricManager::mean(const AttributeColumn& c, float param) { return (float)(c.sum/c.values.size()); }
+float MetricManager::sum(const AttributeColumn& c, float param) { return (float)c.sum; }
+float MetricManager::count(const AttributeColumn& c, float param) { return (float)c.values.size(); }
+float MetricManager::median(const AttributeColumn& c, float param) { return percentile(c.values, 50); }
+float MetricManager::percentile(const AttributeColumn& c, float param) { return percentile(c.values, param); }
 
-  return (float)(std::sqrt(sum/(points.size()-1)));
+float MetricManager::sd(const AttributeColumn& c, float param)
+{
+  if (c.values.size() < 2) return NA_F32_RASTER;
+  return (float)(std::sqrt(c.m2/(c.values.size()-1)));
 }
 
-float MetricManager::mode(AttributeAccessor& accessor, const PointCollection& points, float param) const
+float MetricManager::cv(const AttributeColumn& c, float param)
 {
-  std::unordered_map<double, int> registry;
+  float avg = mean(c, param);
+  float std = sd(c, param);
+  if (avg == 0 || avg == NA_F32_RASTER || std == NA_F32_RASTER) return NA_F32_RASTER;
+  return std/avg;
+}
 
-  for (const auto& point : points)
+float MetricManager::above(const AttributeColumn& c, float param)
+{
+  const double* x = c.values.data();
+  const size_t n = c.values.size();
+  const double threshold = param;
+
+  size_t k = 0;
+  if (c.need_sort)
+  {
+    k = std::distance(std::upper_bound(c.values.begin(), c.values.end(), threshold), c.values.end());
+  }
+  else
   {
-    double value = accessor(&point);
-    registry[value]++;
+    #pragma omp simd reduction(+:k)
+    for (size_t i = 0 ; i < n ; i++) k += (x[i] > threshold);
   }
 
-  double mode = accessor(&points[0]);
-  int count = registry[mode];
+  return (float)k/(float)n;
+}
+
+// Values are sorted: the mode is the longest run. In case of ties the value of the first point is
+// preferred then the smallest value.
+float MetricManager::mode(const AttributeColumn& c, float param)
+{
+  const std::vector<double>& x = c.values;
+
+  double mode = c.first;
+  size_t count = 0;
+
+  // Count of the first point
+  auto range = std::equal_range(x.begin(), x.end(), c.first);
+  count = std::distance(range.first, range.second);
 
-  for (const auto& pair : registry)
+  size_t i = 0;
+  while (i < x.size())
   {
-    if (pair.second > count)
+    size_t j = i;
+    while (j < x.size() && x[j] == x[i]) j++;
+    if (j - i > count)
     {
-      mode = pair.first;
-      count = pair.second;
+      mode = x[i];
+      count = j - i;
     }
+    i = j;
   }
 
   return (float)mode;
 }
 
-float MetricManager::cv(AttributeAccessor& accessor, const PointCollection& points, float param) const
+float MetricManager::skewness(const AttributeColumn& c, float param)
 {
-  float avg = mean(accessor, points, param);
-  float std = sd(accessor, points, param);
-  if (avg == 0 || avg == NA_F32_RASTER || std == NA_F32_RASTER) return NA_F32_RASTER;
-  return std/avg;
+  double n = c.values.size();
+  if (n < 2) return NA_F32_RASTER;
+  return (float)((c.m3/n) / std::pow(c.m2/n, 1.5));
 }
 
-float MetricManager::sum(AttributeAccessor& accessor, const PointCollection& points, float param) const
+float MetricManager::kurtosis(const AttributeColumn& c, float param)
 {
-  double sum = 0;
-  for (const auto& point : points) sum += accessor(&point);
-  return (float)sum;
+  double n = c.values.size();
+  if (n < 2) return NA_F32_RASTER;
+  return (float)((c.m4/n) / std::pow(c.m2/n, 2));
 }
 
-float MetricManager::count(AttributeAccessor& accessor, const PointCollection& points, float param) const
+// Streaming: fold the point p in the value x stored in the raster. Metrics computed
+// from the accumulators are not modified.
+float MetricManager::get_metric(int index, float x, const Point* p)
 {
-  return (float)points.size();
+  StreamingOperator& op = streaming_operators[index];
+  if (op.fold == nullptr) return x;
+  return (this->*op.fold)(x, (float)op.accessor(p));
 }
 
-
-float MetricManager::percentile(AttributeAccessor& accessor, const PointCollection& points, float param) const
+// Streaming: final value of the metric in the cell. x is the value stored in the raster
+float MetricManager::get_metric(int index, int cell, float x) const
 {
-  std::vector<double> x;
-  x.reserve(points.size());
-  for (const auto& point : points) x.push_back(accessor(&point));
-  std::sort(x.begin(), x.end());
-  return percentile(x, param);
+  const StreamingOperator& op = streaming_operators[index];
+  if (op.finalize == nullptr) return x;
+  if (get_moments(op, cell).n == 0) return x;
+  return (this->*op.finalize)(op, cell);
 }
 
-float MetricManager::above(AttributeAccessor& accessor, const PointCollection& points, float param) const
+void MetricManager::init_accumulators(int ncells)
 {
-  float k = 0;
-  for (const auto& point : points)
-    if (accessor(&point) > param) k++;
-  return k/(float)points.size();
+  moments.assign((size_t)ncells*n_moments, MomentAccumulator());
+  counters.assign((size_t)ncells*n_counters, 0);
+  sketches.assign((size_t)ncells*n_sketches, TDigest());
 }
 
-float MetricManager::moment(AttributeAccessor& accessor, const PointCollection& points, float param) const
+void MetricManager::clear_accumulators()
 {
-  if (points.size() < 2) return NA_F32_RASTER;
-  if (param <= 1) return 0.0f;
-  if (param <= 2) return 1.0f;
-
-  double n = points.size();
+  moments.clear();
+  moments.shrink_to_fit();
+  counters.clear();
+  counters.shrink_to_fit();
+  sketches.clear();
+  sketches.shrink_to_fit();
+}
 
-  float mean_val = mean(accessor, points, 0);
+void MetricManager::accumulate(int cell, const Point* p)
+{
+  if (n_moments > 0)
+  {
+    MomentAccumulator* acc = &moments[(size_t)cell*n_moments];
+    for (int j = 0 ; j < n_moments ; j++)
+      acc[j].add(moment_accessors[j](p));
+  }
 
-  double numerator = 0.0;
-  double denominator = 0.0;
-  for (const auto& point : points)
+  if (n_counters > 0)
   {
-    double value = accessor(&point);
-    double diff = value - mean_val;
-    numerator += std::pow(diff, param);
-    denominator += std::pow(diff, 2);
+    uint32_t* k = &counters[(size_t)cell*n_counters];
+    for (auto& op : streaming_operators)
+    {
+      if (op.counter >= 0 && op.accessor(p) > op.param)
+        k[op.counter]++;
+    }
   }
 
-  numerator = (1/n)*numerator;
-  denominator = (1/n)*denominator;
-  denominator = std::pow(denominator, param/2);
-  return (float)(numerator / denominator);
+  if (n_sketches > 0)
+  {
+    TDigest* digest = &sketches[(size_t)cell*n_sketches];
+    for (int j = 0 ; j < n_sketches ; j++)
+      digest[j].add(sketch_accessors[j](p));
+  }
 }
 
-float MetricManager::skewness(AttributeAccessor& accessor, const PointCollection& points, float param) const
+float MetricManager::get_metric(int index, const PointCollection& points)
 {
-  return moment(accessor, points, 3);
+  if (points.size() == 0) return default_value;
+  const MetricCalculator& op = regular_operators[index];
+  AttributeColumn& c = columns[op.get_column()];
+  c.compute(points);
+  return op.compute(c);
 }
 
-float MetricManager::kurtosis(AttributeAccessor& accessor, const PointCollection& points, float param) const
+// Compute all the metrics in a single pass per attribute. This must be preferred to calling
+// get_metric() for each metric
+void MetricManager::get_metrics(const PointCollection& points, std::vector<float>& values)
 {
-  return moment(accessor, points, 4);
-}
+  values.resize(regular_operators.size());
 
+  if (points.size() == 0)
+  {
+    std::fill(values.begin(), values.end(), default_value);
+    return;
+  }
 
+  for (auto& c : columns) c.compute(points);
 
-float MetricManager::get_metric(int index, float x, float y) const
-{
-  const StreamingMetric& f = streaming_operators[index];
-  return (this->*f)(x,y);
-}
-
-float MetricManager::get_metric(int index, const PointCollection& points)
-{
-  if (points.size() == 0) return default_value;
-  return regular_operators[index].compute(points);
+  for (size_t i = 0 ; i < regular_operators.size() ; i++)
+  {
+    const MetricCalculator& op = regular_operators[i];
+    values[i] = op.compute(columns[op.get_column()]);
+  }
 }
 
-double MetricManager::percentile(const std::vector<double>& x, float p) const
+double MetricManager::percentile(const std::vector<double>& x, float p)
 {
   float rank = (p / 100.0f) * ((float)x.size() - 1) + 1;
   int lowerIndex = (int)(std::floor(rank)) - 1;
@@ -304,7 +500,7 @@ double MetricManager::percentile(const std::vector<double>& x, float p) const
 
 int MetricManager::size() const
 {
-  return (streamable) ? (int)streaming_operators.size() : (int)regular_operators.size();
+  return (int)regular_operators.size();
 };
 
 bool MetricManager::active() const
@@ -315,8 +511,17 @@ bool MetricManager::active() const
 
 void MetricManager::reset()
 {
-  for(auto& op : regular_operators)
-    op.reset();
+  for(auto& c : columns)
+    c.accessor.reset();
+
+  for(auto& op : streaming_operators)
+    op.accessor.reset();
+
+  for(auto& accessor : moment_accessors)
+    accessor.reset();
+
+  for(auto& accessor : sketch_accessors)
+    accessor.reset();
 }
 
 float MetricManager::string_to_float(const std::string& s) const
@@ -337,6 +542,9 @@ MetricManager::MetricManager()
 {
   streamable = false;
   default_value = NA_F32_RASTER;
+  n_moments = 0;
+  n_counters = 0;
+  n_sketches = 0;
 }
 
 MetricManager::~MetricManager()
@@ -3,28 +3,64 @@
 
 #include <vector>
 #include <string>
-#include <functional>
 #include <unordered_map>
+#include <cstdint>
 
 #include "PointSchema.h"
+#include "TDigest.h"
 
 using PointCollection = std::vector<Point>;
-using MetricComputation = std::function<float(AttributeAccessor&, const PointCollection&, float)>;
+
+// Values of an attribute for a group of points and the intermediates shared by all the metrics
+// derived from this attribute. The values are extracted once, sorted once if a metric needs order
+// statistics and the central moments are computed once if a metric needs them.
+struct AttributeColumn
+{
+  AttributeColumn(const std::string& name) : name(name), accessor(name) {}
+  void compute(const PointCollection& points);
+
+  std::string name;
+  AttributeAccessor accessor;
+  bool need_sort = false;      // median, percentiles, mode
+  bool need_moments = false;   // sd, cv, skew, kurt
+  std::vector<double> values;  // sorted if need_sort
+  double first;                // value of the first point
+  double min;
+  double max;
+  double sum;
+  double m2;                   // sums of the 2nd, 3rd and 4th powers of the deviations to the mean
+  double m3;
+  double m4;
+};
+
+// Metrics are plain functions selected when the metric string is parsed
+typedef float (*MetricComputation)(const AttributeColumn&, float);
 
 class MetricCalculator
 {
 public:
-  MetricCalculator(MetricComputation computation, AttributeAccessor& accessor, float param) : computation(computation), accessor(accessor), param(param) {}
-  float compute(const PointCollection& points) { return computation(accessor, points, param); }
-  void set_param(float x) { param = x; }
-  void reset() { accessor.reset(); };
+  MetricCalculator(MetricComputation computation, int column, float param) : computation(computation), column(column), param(param) {}
+  float compute(const AttributeColumn& values) const { return computation(values, param); }
+  int get_column() const { return column; }
 
 private:
   MetricComputation computation;
-  AttributeAccessor accessor;
+  int column;
   float param;
 };
 
+// Online accumulator of the first four central moments of a variable (Welford's update extended
+// to higher orders by Terriberry). It uses a constant amount of memory and is numerically stable.
+struct MomentAccumulator
+{
+  uint32_t n = 0;
+  double mean = 0;
+  double m2 = 0;
+  double m3 = 0;
+  double m4 = 0;
+  void add(double x);
+};
+
 class MetricManager
 {
 public:
@@ -34,49 +70,97 @@ public:
   int size() const;
   bool active() const;
   float get_metric(int index, const PointCollection& points);
-  float get_metric(int index, float x, float y) const;
+  void get_metrics(const PointCollection& points, std::vector<float>& values);
+  float get_metric(int index, float x, const Point* p);
+  float get_metric(int index, int cell, float x) const;
   const std::string& get_name(int index) { return names[index]; }
   float get_default_value() const { return default_value; }
   void set_default_value(float val) { default_value = val; }
   bool is_streamable() const { return streamable; }
   void reset();
 
+  // Streaming metrics that need more than the value stored in the raster (mean, sd, above...)
+  // accumulate the points of each cell. The final values are computed with get_metric(index, cell, x)
+  bool need_accumulators() const { return n_moments + n_counters + n_sketches > 0; }
+  void init_accumulators(int ncells);
+  void clear_accumulators();
+  void accumulate(int cell, const Point* p);
+
 private:
-  double percentile(const std::vector<double>& x, float p) const;
+  // Metrics such as z_max, z_mean or i_sd can be streamed. max, min and count are folded in the
+  // value stored in the raster. Others are computed from accumulators stored per cell: moments
+  // per attribute ('moment' is the index of the attribute), a counter of points above the threshold
+  // for aboveXX ('counter' is the index of the counter) and a t-digest per attribute for approximate
+  // percentiles ('sketch' is the index of the attribute)
+  struct StreamingOperator;
+  typedef float (MetricManager::*StreamingMetric)(float, float) const;
+  typedef float (MetricManager::*StreamingFinalizer)(const StreamingOperator&, int) const;
+  struct StreamingOperator
+  {
+    StreamingMetric fold;
+    StreamingFinalizer finalize;
+    AttributeAccessor accessor;
+    float param;
+    int moment;
+    int counter;
+    int sketch;
+  };
+
+  static double percentile(const std::vector<double>& x, float p);
   float string_to_float(const std::string& s) const;
 
-  // Streamable metrics
+  // Streamable metrics folded in the value stored in the raster
   float pmax  (float x, float y) const;
   float pmin  (float x, float y) const;
   float pcount(float x, float y) const;
 
-  // Non-streamable metrics
-  float min(AttributeAccessor& accessor, const PointCollection& points, float param) const;
-  float max(AttributeAccessor& accessor, const PointCollection& points, float param) const;
-  float mean(AttributeAccessor& accessor, const PointCollection& points, float param) const;
-  float median(AttributeAccessor& accessor, const PointCollection& points, float param) const;
-  float sd(AttributeAccessor& accessor, const PointCollection& points, float param) const;
-  float cv(AttributeAccessor& accessor, const PointCollection& points, float param) const;
-  float sum(AttributeAccessor& accessor, const PointCollection& points, float param) const;
-  float percentile(AttributeAccessor& accessor, const PointCollection& points, float param) const;
-  float above(AttributeAccessor& accessor, const PointCollection& points, float param) const;
-  float count(AttributeAccessor& accessor, const PointCollection& points, float param) const;
-  float mode(AttributeAccessor& accessor, const PointCollection& points, float param) const;
-  float moment(AttributeAccessor& accessor, const PointCollection& points, float param) const;
-  float skewness(AttributeAccessor& accessor, const PointCollection& points, float param) const;
-  float kurtosis(AttributeAccessor& accessor, const PointCollection& points, float param) const;
+  // Streamable metrics computed from the accumulators
+  float pmean (const StreamingOperator& op, int cell) const;
+  float psum  (const StreamingOperator& op, int cell) const;
+  float psd   (const StreamingOperator& op, int cell) const;
+  float pcv   (const StreamingOperator& op, int cell) const;
+  float pskew (const StreamingOperator& op, int cell) const;
+  float pkurt (const StreamingOperator& op, int cell) const;
+  float pabove(const StreamingOperator& op, int cell) const;
+  float pquantile(const StreamingOperator& op, int cell) const;
+  const MomentAccumulator& get_moments(const StreamingOperator& op, int cell) const { return moments[(size_t)cell*n_moments + op.moment]; }
+
+  // Batch metrics. Kernels running on the contiguous values of an AttributeColumn
+  static float min(const AttributeColumn& c, float param);
+  static float max(const AttributeColumn& c, float param);
+  static float mean(const AttributeColumn& c, float param);
+  static float median(const AttributeColumn& c, float param);
+  static float sd(const AttributeColumn& c, float param);
+  static float cv(const AttributeColumn& c, float param);
+  static float sum(const AttributeColumn& c, float param);
+  static float percentile(const AttributeColumn& c, float param);
+  static float above(const AttributeColumn& c, float param);
+  static float count(const AttributeColumn& c, float param);
+  static float mode(const AttributeColumn& c, float param);
+  static float skewness(const AttributeColumn& c, float param);
+  static float kurtosis(const AttributeColumn& c, float param);
 
   float default_value;
   std::vector<std::string> names;
 
-  // Predefined metrics such as z_max or z_min can be streamed. We use a pointer to simple functions.
   bool streamable;
-  typedef float (MetricManager::*StreamingMetric)(float, float) const;
-  std::vector<StreamingMetric> streaming_operators;
-
-  // Regular metrics can't be streamed. We use a parser and a MetricCalculator object to handle the complexity of the system.
+  std::vector<StreamingOperator> streaming_operators;
+  std::vector<AttributeAccessor> moment_accessors;
+  std::vector<AttributeAccessor> sketch_accessors;
+  std::vector<MomentAccumulator> moments;
+  std::vector<uint32_t> counters;
+  std::vector<TDigest> sketches;
+  int n_moments;
+  int n_counters;
+  int n_sketches;
+
+  // Regular metrics are computed on a group of points. We use a parser and a MetricCalculator object to
+  // handle the complexity of the system. The metrics are planned per attribute: each MetricCalculator
+  // reads the values and intermediates of an AttributeColumn shared by all the metrics of this attribute.
   MetricCalculator parse(const std::string& name);
+  void parse(const std::string& name, std::string& attribute, std::string& metric, float& param);
   std::vector<MetricCalculator> regular_operators;
+  std::vector<AttributeColumn> columns;
 
   // Map of string to attribute accessors
   /*std::unordered_map<std::string, AttributeAccessor> attribute_functions = {
@@ -127,19 +211,39 @@ private:
 
   // Map of string to metric functions
   std::unordered_map<std::string, MetricComputation> metric_functions = {
-    {"max", [this](AttributeAccessor& accessor, const PointCollection& points, float param) { return max(accessor, points, param); }},
-    {"min", [this](AttributeAccessor& accessor, const PointCollection& points, float param) { return min(accessor, points, param); }},
-    {"mean", [this](AttributeAccessor& accessor, const PointCollection& points, float param) { return mean(accessor, points, param); }},
-    {"median", [this](AttributeAccessor& accessor, const PointCollection& points, float param) { return median(accessor, points, param); }},
-    {"sd", [this](AttributeAccessor& accessor, const PointCollection& points, float param) { return sd(accessor, points, param); }},
-    {"cv", [this](AttributeAccessor& accessor, const PointCollection& points, float param) { return cv(accessor, points, param); }},
-    {"sum", [this](AttributeAccessor& accessor, const PointCollection& points, float param) { return sum(accessor, points, param); }},
-    {"above", [this](AttributeAccessor& accessor, const PointCollection& points, float param) { return above(accessor, points, param); }},
-    {"mode", [this](AttributeAccessor& accessor, const PointCollection& points, float param) { return mode(accessor, points, param); }},
-    {"count", [this](AttributeAccessor& accessor, const PointCollection& points, float param) { return count(accessor, points, param); }},
-    {"p", [this](AttributeAccessor& accessor, const PointCollection& points, float param) { return percentile(accessor, points, param); }},
-    {"skew", [this](AttributeAccessor& accessor, const PointCollection& points, float param) { return skewness(accessor, points, param); }},
-    {"kurt", [this](AttributeAccessor& accessor, const PointCollection& points, float param) { return kurtosis(accessor, points, param); }},
+    {"max", &MetricManager::max},
+    {"min", &MetricManager::min},
+    {"mean", &MetricManager::mean},
+    {"median", &MetricManager::median},
+    {"sd", &MetricManager::sd},
+    {"cv", &MetricManager::cv},
+    {"sum", &MetricManager::sum},
+    {"above", &MetricManager::above},
+    {"mode", &MetricManager::mode},
+    {"count", &MetricManager::count},
+    {"p", &MetricManager::percentile},
+    {"skew", &MetricManager::skewness},
+    {"kurt", &MetricManager::kurtosis},
+
+    // Approximate percentiles are exact when the points are loaded
+    {"p~", &MetricManager::percentile},
+    {"median~", &MetricManager::median},
+  };
+
+  // Map of the metrics that can be streamed to their finalizer (nullptr for metrics folded in the raster)
+  std::unordered_map<std::string, StreamingFinalizer> streamable_metrics = {
+    {"max", nullptr},
+    {"min", nullptr},
+    {"count", nullptr},
+    {"mean", &MetricManager::pmean},
+    {"sum", &MetricManager::psum},
+    {"sd", &MetricManager::psd},
+    {"cv", &MetricManager::pcv},
+    {"skew", &MetricManager::pskew},
+    {"kurt", &MetricManager::pkurt},
+    {"above", &MetricManager::pabove},
+    {"p~", &MetricManager::pquantile},
+    {"median~", &MetricManager::pquantile},
   };
 };
 
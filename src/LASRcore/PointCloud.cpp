@@ -468,6 +468,15 @@ bool PointCloud::query(const Shape* const shape, std::vector<Point>& addr, Point
   return addr.size() > 0;
 }
 
+// Intervals of point indexes that may be in the bounding box of the shape. Nothing is copied, the
+// caller walks the spans and tests the points itself
+bool PointCloud::query(const Shape* const shape, std::vector<Interval>& intervals) const
+{
+  intervals.clear();
+  index->query(shape->xmin(), shape->ymin(), shape->xmax(), shape->ymax(), intervals);
+  return intervals.size() > 0;
+}
+
 bool PointCloud::query(const std::vector<Interval>& intervals, std::vector<Point>& addr, PointFilter* const filter) const
 {
   Point p;
@@ -584,6 +593,28 @@ bool PointCloud::knn(const Point& xyz, int k, double radius_max, std::vector<Poi
   return true;
 }
 
+bool PointCloud::query(const int* first, const int* last, std::vector<Point>& addr, PointFilter* const filter) const
+{
+  Point p;
+  p.set_schema(&header->schema);
+
+  addr.clear();
+
+  for (const int* it = first ; it != last ; it++)
+  {
+    p.data = buffer + (size_t)(*it) * header->schema.total_point_size;
+
+    if (filter && filter->filter(&p)) continue;
+
+    if (!p.get_deleted())
+    {
+      addr.push_back(p);
+    }
+  }
+
+  return addr.size() > 0;
+}
+
 bool PointCloud::get_point(size_t pos, Point* p, PointFilter* const filter) const
 {
   p->data = buffer + pos * header->schema.total_point_size;
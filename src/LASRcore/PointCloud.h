@@ -39,7 +39,9 @@ public:
   // Thread safe queries
   bool get_point(size_t pos, Point* p, PointFilter* const filter = nullptr) const;
   bool query(const Shape* const shape, std::vector<Point>& addr, PointFilter* const filter = nullptr) const;
+  bool query(const Shape* const shape, std::vector<Interval>& intervals) const;
   bool query(const std::vector<Interval>& intervals, std::vector<Point>& addr, PointFilter* const filter = nullptr) const;
+  bool query(const int* first, const int* last, std::vector<Point>& addr, PointFilter* const filter = nullptr) const;
   bool knn(const Point& xyz, int k, double radius_max, std::vector<Point>& res, PointFilter* const filter = nullptr) const;
 
   int get_index(Point* p) { size_t index = (size_t)(p->data - buffer); return(index/header->schema.total_point_size); }
@@ -1,5 +1,7 @@
 #include "PointSchema.h"
 
+#include <cstring>
+
 Attribute::Attribute(const std::string& name, AttributeType type, double scale_factor, double value_offset, const std::string& description)
 {
   this->name = name;
@@ -170,6 +172,61 @@ double AttributeAccessor::operator()(const Point* point)
   return read(point);
 }
 
+// Reads the attribute of several points in a contiguous array. The type is resolved once for all
+// the points instead of once per point.
+template<typename T>
+static void read_column(const std::vector<Point>& points, const Attribute* attribute, double* values)
+{
+  const size_t offset = attribute->offset;
+  const double scale_factor = attribute->scale_factor;
+  const double value_offset = attribute->value_offset;
+  for (size_t i = 0 ; i < points.size() ; i++)
+  {
+    T value;
+    std::memcpy(&value, points[i].data + offset, sizeof(T));
+    values[i] = value_offset + scale_factor * static_cast<double>(value);
+  }
+}
+
+void AttributeAccessor::operator()(const std::vector<Point>& points, std::vector<double>& values)
+{
+  values.resize(points.size());
+  if (points.empty()) return;
+
+  if (!init)
+  {
+    attribute = points[0].schema->find_attribute(name);
+    init = true;
+  }
+
+  if (!attribute)
+  {
+    std::fill(values.begin(), values.end(), default_value);
+    return;
+  }
+
+  double* x = values.data();
+
+  switch (attribute->type)
+  {
+  case BIT:
+    for (size_t i = 0 ; i < points.size() ; i++)
+      x[i] = attribute->value_offset + attribute->scale_factor * static_cast<double>((points[i].data[attribute->offset] >> attribute->bit_pos) & 1);
+    break;
+  case UINT8: read_column<uint8_t>(points, attribute, x); break;
+  case INT8: read_column<int8_t>(points, attribute, x); break;
+  case UINT16: read_column<uint16_t>(points, attribute, x); break;
+  case INT16: read_column<int16_t>(points, attribute, x); break;
+  case UINT32: read_column<uint32_t>(points, attribute, x); break;
+  case INT32: read_column<int32_t>(points, attribute, x); break;
+  case UINT64: read_column<uint64_t>(points, attribute, x); break;
+  case INT64: read_column<int64_t>(points, attribute, x); break;
+  case FLOAT: read_column<float>(points, attribute, x); break;
+  case DOUBLE: read_column<double>(points, attribute, x); break;
+  default: std::fill(values.begin(), values.end(), default_value); break;
+  }
+}
+
 void AttributeAccessor::operator()(Point* point, double value)
 {
   write(point, value);
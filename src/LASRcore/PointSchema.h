@@ -312,6 +312,7 @@ public:
   // Overloaded operators for reading and writing
   double operator()(const Point* point);
   void operator()(Point* point, double value);
+  void operator()(const std::vector<Point>& points, std::vector<double>& values);
   bool exist() { return attribute != nullptr; }
   void reset() { init = false; attribute = nullptr; };
 
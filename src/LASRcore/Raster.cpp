@@ -2,8 +2,11 @@
 #include "NA.h"
 
 #include "print.h"
+#include "openmp.h"
 
 #include <cmath>
+#include <limits>
+#include <algorithm>
 
 // Default constructor creates a Raster from (0,0) to (0,0) with a resolution of 0
 // GDALdataset is NOT initialized.
@@ -56,6 +59,8 @@ Raster::Raster(const Raster& raster) : Grid(raster), GDALdataset()
   band_names = raster.band_names;
   nodata = raster.nodata;
   oSRS = raster.oSRS;
+  creation_options = raster.creation_options;
+  cog = raster.cog;
 }
 
 // Copy constructor with bounding box. Creates a raster identical to the input
@@ -72,6 +77,8 @@ Raster::Raster(const Raster& raster, const Chunk& chunk) : Grid (chunk.xmin, chu
   band_names = raster.band_names;
   nodata = raster.nodata;
   oSRS = raster.oSRS;
+  creation_options = raster.creation_options;
+  cog = raster.cog;
 
   set_chunk(chunk); // #15 resize the grid including the buffer
 }
@@ -222,6 +229,55 @@ void Raster::set_value(int cell, float value, int layer)
     data[cell + (layer-1)*ncells] = value;
 }
 
+// Scan conversion of a triangle. The triangle is expressed in (column, row) space with the top
+// left corner of the raster at the origin. Each row of cell centers crossed by the triangle is
+// clipped by the three edge functions, which gives the range of columns, and the plane is evaluated
+// at each cell center. The values may differ from TriangleXYZ::linear_interpolation() by the last
+// bits. If 'overwrite' is false only the cells that are still nodata are written. The first call allocates the memory and is not thread safe.
+void Raster::set_triangle(const TriangleXYZ& triangle, bool overwrite, int layer)
+{
+  const PointXYZ& a = triangle.A;
+  const PointXYZ& b = triangle.B;
+  const PointXYZ& c = triangle.C;
+
+  double x0 = xmin;
+  double y0 = ymax;
+
+  TriangleEdges edges;
+  if (!edges.init(PointXYZ((a.x-x0)/xres, (y0-a.y)/yres, a.z), PointXYZ((b.x-x0)/xres, (y0-b.y)/yres, b.z), PointXYZ((c.x-x0)/xres, (y0-c.y)/yres, c.z), std::sqrt(EPSILON)/xres))
+    return;
+
+  if (data.size() == 0)
+  {
+    data.resize(nBands*ncells);
+    std::fill(data.begin(), data.end(), nodata);
+  }
+
+  float* band = data.data() + (size_t)(layer-1)*ncells;
+
+  // Cell centers are at (col+0.5, row+0.5)
+  int rmin = std::max(0, (int)std::ceil(edges.ymin - 0.5));
+  int rmax = std::min(nrows-1, (int)std::floor(edges.ymax - 0.5));
+  for (int row = rmin ; row <= rmax ; row++)
+  {
+    double y = row + 0.5;
+
+    double lo, hi;
+    if (!edges.span(y, lo, hi)) continue;
+
+    int cmin = std::max(0, (int)std::ceil(lo - 0.5));
+    int cmax = std::min(ncols-1, (int)std::floor(hi - 0.5));
+
+    double zrow = edges.z0 + edges.gy*y;
+    float* cell = band + cell_from_row_col(row, cmin);
+    for (int col = cmin ; col <= cmax ; col++)
+    {
+      if (overwrite || *cell == nodata) *cell = (float)(zrow + edges.gx*(col + 0.5));
+      cell++;
+    }
+  }
+}
+
 bool Raster::set_nbands(int nbands)
 {
   if (!GDALdataset::set_nbands(nbands))
@@ -282,55 +338,250 @@ void Raster::set_chunk(const Chunk& chunk)
   std::fill(data.begin(), data.end(), nodata);
 }
 
-bool Raster::focal(float size, float (*operation)(std::vector<float>&))
+// The focal functions are sliding window algorithms. The circular window is described row by row
+// (see hw below) so each output pixel costs O(window diameter) instead of O(window area):
+// - sum and mean: prefix sums along the rows
+// - min and max: van Herk/Gil-Werman running extremum along the rows
+// - median: histogram of the ranks of the values updated incrementally while sliding along a row
+// The rows are processed in parallel.
+bool Raster::focal(float size, int fun, int ncpu)
 {
+  if (data.empty()) return true;
+
   int psize = std::ceil(size/xres); // pixel size of the windows
 
   float square_radius = std::pow(size/2.0, 2);
   if (square_radius < xres/2) square_radius = std::pow(xres/2, 2);
 
+  // Circular windows: the row at offset dr in [-psize, psize] spans the columns [-hw, +hw]
+  // around the center. hw = -1 if the row is not part of the window.
+  std::vector<int> hw(2*psize+1, -1);
+  for (int dr = -psize ; dr <= psize ; dr++)
+  {
+    for (int dc = 0 ; dc < psize ; dc++)
+    {
+      float square_dist = std::pow(dr*yres, 2) + std::pow(dc*xres, 2);
+      if (square_dist > square_radius) break;
+      hw[dr+psize] = dc;
+    }
+  }
+
   // The new vector of data
   std::vector<float> ans(data.size(), nodata);
 
-  // Temporary vector allocated to store raster values of the current windows
-  std::vector<float> vals;
-  vals.reserve(128);
-
   // Apply the focal on all the bands
   for (int band = 1; band <= nBands; band++)
   {
-    for (int cell = 0; cell < ncells; cell++)
+    const float* in = data.data() + (size_t)(band-1)*ncells;
+    float* out = ans.data() + (size_t)(band-1)*ncells;
+
+    switch (fun)
     {
-      float center_val = get_value(cell, band);
-      int center_row = row_from_cell(cell);
-      int center_col = col_from_cell(cell);
+      case FOCAL_MEAN: focal_sum(in, out, hw, true, ncpu); break;
+      case FOCAL_SUM: focal_sum(in, out, hw, false, ncpu); break;
+      case FOCAL_MIN: focal_extremum(in, out, hw, false, ncpu); break;
+      case FOCAL_MAX: focal_extremum(in, out, hw, true, ncpu); break;
+      case FOCAL_MEDIAN: focal_median(in, out, hw, ncpu); break;
+      default:
+        last_error = "Internal error: unknown focal function"; // # nocov
+        return false; // # nocov
+    }
+  }
 
-      for (int row = std::max(0, center_row - psize); row < std::min(nrows, center_row + psize); row++)
-      {
-        for (int col = std::max(0, center_col - psize); col < std::min(ncols, center_col + psize); col++)
-        {
-          float val = (*this)(row, col, band);
-          if (val == nodata) continue;
+  std::swap(data, ans);
 
-          // Circular windows
-          float square_dist = std::pow((row - center_row)*yres, 2) + std::pow((col - center_col)*xres, 2);
-          if (square_dist <= square_radius)
-            vals.push_back(val);
-        }
+  return true;
+}
+
+void Raster::focal_sum(const float* in, float* out, const std::vector<int>& hw, bool mean, int ncpu) const
+{
+  int psize = (hw.size()-1)/2;
+  size_t stride = ncols+1;
+
+  // Prefix sums of the values and of the number of values along each row
+  std::vector<double> sums(nrows*stride, 0);
+  std::vector<int> counts(nrows*stride, 0);
+  for (int row = 0 ; row < nrows ; row++)
+  {
+    for (int col = 0 ; col < ncols ; col++)
+    {
+      float val = in[row*ncols+col];
+      bool na = val == nodata;
+      sums[row*stride+col+1] = sums[row*stride+col] + (na ? 0 : val);
+      counts[row*stride+col+1] = counts[row*stride+col] + (na ? 0 : 1);
+    }
+  }
+
+  parallel_for(nrows, ncpu, [&](int64_t row)
+  {
+    for (int col = 0 ; col < ncols ; col++)
+    {
+      double sum = 0;
+      int n = 0;
+      for (int dr = -psize ; dr <= psize ; dr++)
+      {
+        int r = row + dr;
+        int h = hw[dr+psize];
+        if (h < 0 || r < 0 || r >= nrows) continue;
+
+        size_t start = r*stride + std::max(0, col-h);
+        size_t end = r*stride + std::min(ncols, col+h+1);
+        sum += sums[end] - sums[start];
+        n += counts[end] - counts[start];
       }
 
-      if (!vals.empty())
+      if (n > 0) out[row*ncols+col] = (mean) ? sum/n : sum;
+    }
+  });
+}
+
+void Raster::focal_extremum(const float* in, float* out, const std::vector<int>& hw, bool max, int ncpu) const
+{
+  int psize = (hw.size()-1)/2;
+
+  // Neutral element. NAs and the pixels beyond the edges are replaced by this value
+  const float none = (max) ? -std::numeric_limits<float>::infinity() : std::numeric_limits<float>::infinity();
+
+  parallel_for(nrows, ncpu, [&, acc = std::vector<float>(), win = std::vector<float>(), fwd = std::vector<float>(), bwd = std::vector<float>()](int64_t row) mutable
+  {
+    auto op = [max](float a, float b) { return (max) ? std::max(a,b) : std::min(a,b); };
+
+    acc.assign(ncols, none);
+
+    for (int dr = -psize ; dr <= psize ; dr++)
+    {
+      int r = row + dr;
+      int h = hw[dr+psize];
+      if (h < 0 || r < 0 || r >= nrows) continue;
+
+      // The row is padded with h values on each side so that the window of the column 'col' is
+      // [col, col+k-1] in the padded row. The padded row is split in blocks of k values and the
+      // extremum of a window is the extremum of a suffix of a block and of a prefix of the next one.
+      int k = 2*h+1;
+      int n = ncols + 2*h;
+      win.resize(n);
+      fwd.resize(n);
+      bwd.resize(n);
+
+      for (int i = 0 ; i < n ; i++)
       {
-        ans[(band - 1) * ncells + cell] = operation(vals);
+        int col = i - h;
+        float val = (col >= 0 && col < ncols) ? in[r*ncols+col] : none;
+        win[i] = (val == nodata) ? none : val;
       }
 
-      vals.clear();
+      for (int i = 0 ; i < n ; i++)
+        fwd[i] = (i % k == 0) ? win[i] : op(fwd[i-1], win[i]);
+
+      for (int i = n-1 ; i >= 0 ; i--)
+        bwd[i] = (i == n-1 || (i+1) % k == 0) ? win[i] : op(bwd[i+1], win[i]);
+
+      for (int col = 0 ; col < ncols ; col++)
+        acc[col] = op(acc[col], op(bwd[col], fwd[col+k-1]));
     }
+
+    for (int col = 0 ; col < ncols ; col++)
+    {
+      if (acc[col] != none) out[row*ncols+col] = acc[col];
+    }
+  });
+}
+
+void Raster::focal_median(const float* in, float* out, const std::vector<int>& hw, int ncpu) const
+{
+  int psize = (hw.size()-1)/2;
+
+  // The values are replaced by their rank among the distinct values of the band. A window
+  // is then a histogram of ranks with a coarse histogram on top of it to find the k-th value quickly
+  std::vector<float> levels;
+  levels.reserve(ncells);
+  for (int cell = 0 ; cell < ncells ; cell++)
+  {
+    if (in[cell] != nodata) levels.push_back(in[cell]);
   }
 
-  std::swap(data, ans);
+  if (levels.empty()) return;
 
-  return true;
+  std::sort(levels.begin(), levels.end());
+  levels.erase(std::unique(levels.begin(), levels.end()), levels.end());
+
+  std::vector<int> ranks(ncells, -1);
+  for (int cell = 0 ; cell < ncells ; cell++)
+  {
+    if (in[cell] != nodata) ranks[cell] = std::lower_bound(levels.begin(), levels.end(), in[cell]) - levels.begin();
+  }
+
+  int nlevels = levels.size();
+  int binsize = std::max(1, (int)std::sqrt(nlevels));
+  int nbins = (nlevels + binsize - 1)/binsize;
+
+  parallel_for(nrows, ncpu, [&, hist = std::vector<int>(), coarse = std::vector<int>()](int64_t row) mutable
+  {
+    // Allocated once per thread. The histograms are empty again at the end of each row
+    if (hist.empty())
+    {
+      hist.assign(nlevels, 0);
+      coarse.assign(nbins, 0);
+    }
+
+    int n = 0;
+
+    auto update = [&](int r, int col, int inc)
+    {
+      int rank = ranks[r*ncols+col];
+      if (rank < 0) return;
+      hist[rank] += inc;
+      coarse[rank/binsize] += inc;
+      n += inc;
+    };
+
+    auto kth = [&](int k)
+    {
+      int bin = 0;
+      while (k >= coarse[bin]) { k -= coarse[bin]; bin++; }
+      int rank = bin*binsize;
+      while (k >= hist[rank]) { k -= hist[rank]; rank++; }
+      return levels[rank];
+    };
+
+    // Window of the first column
+    for (int dr = -psize ; dr <= psize ; dr++)
+    {
+      int r = row + dr;
+      int h = hw[dr+psize];
+      if (h < 0 || r < 0 || r >= nrows) continue;
+      for (int col = 0 ; col <= std::min(h, ncols-1) ; col++) update(r, col, 1);
+    }
+
+    for (int col = 0 ; col < ncols ; col++)
+    {
+      if (n > 0)
+      {
+        if (n % 2 == 0)
+          out[row*ncols+col] = (kth(n/2-1) + kth(n/2)) / 2;
+        else
+          out[row*ncols+col] = kth(n/2);
+      }
+
+      // Slide the window to the next column. After the last column the window is emptied.
+      for (int dr = -psize ; dr <= psize ; dr++)
+      {
+        int r = row + dr;
+        int h = hw[dr+psize];
+        if (h < 0 || r < 0 || r >= nrows) continue;
+
+        if (col < ncols-1)
+        {
+          if (col-h >= 0) update(r, col-h, -1);
+          if (col+h+1 < ncols) update(r, col+h+1, 1);
+        }
+        else
+        {
+          for (int c = std::max(0, col-h) ; c < ncols ; c++) update(r, c, -1);
+        }
+      }
+    }
+  });
 }
 
 bool Raster::get_chunk(const Chunk& chunk, int band_index)
@@ -368,7 +619,6 @@ bool Raster::get_chunk(const Chunk& chunk, int band_index)
   if (maxy > extent[3]) maxy = extent[3];
   int ncols = std::round((maxx-minx)/xres);
   int nrows = std::round((maxy-miny)/yres);
-  int ncells = ncols*nrows;
 
   // Read raster data
   GDALRasterBand *band = dataset->GetRasterBand(band_index);
@@ -380,16 +630,6 @@ bool Raster::get_chunk(const Chunk& chunk, int band_index)
   int xoffset = std::floor((minx - geo_transform[0]) / geo_transform[1]);
   int yoffset = std::floor((maxy - geo_transform[3]) / geo_transform[5]);
 
-  // Read raster data
-  void* gdal_buffer = CPLMalloc(ncells*sizeof(float));
-  CPLErr err = band->RasterIO(GF_Read, xoffset, yoffset, ncols, nrows, gdal_buffer, ncols, nrows, GDT_Float32, 0, 0);
-
-  if (err != CE_None)
-  {
-    last_error = std::string(CPLGetLastErrorMsg()); // # nocov
-    return false; // # nocov
-  }
-
   // This is the grid corresponding the data actually read
   Grid gdal_grid(minx, miny, maxx, maxy, nrows, ncols);
 
@@ -397,17 +637,32 @@ bool Raster::get_chunk(const Chunk& chunk, int band_index)
   data.resize(this->ncells);
   std::fill(data.begin(), data.end(), nodata);
 
-  // Copy the data read from the raster to the actual chunk by celll
-  for (int i = 0 ; i < ncols*nrows ; i++)
+  // Both grids have the same resolution. The data read is thus a block of the chunk at a constant
+  // row and column offset. The offset is computed once from the center of the first cell.
+  int col_offset = std::floor((gdal_grid.x_from_cell(0) - this->xmin) / xres);
+  int row_offset = std::floor((this->ymax - gdal_grid.y_from_cell(0)) / yres);
+
+  // Rows and columns that actually fall in the chunk
+  int col_start = std::max(0, -col_offset);
+  int row_start = std::max(0, -row_offset);
+  int col_end = std::min(ncols, this->ncols - col_offset);
+  int row_end = std::min(nrows, this->nrows - row_offset);
+  if (col_end <= col_start || row_end <= row_start) return true;
+
+  // Read the raster data directly at the right place with the line spacing of the chunk
+  float* first = &data[(size_t)(row_offset + row_start) * this->ncols + col_offset + col_start];
+  GSpacing pixel_space = sizeof(float);
+  GSpacing line_space = (GSpacing)this->ncols*sizeof(float);
+  int width = col_end - col_start;
+  int height = row_end - row_start;
+  CPLErr err = band->RasterIO(GF_Read, xoffset + col_start, yoffset + row_start, width, height, first, width, height, GDT_Float32, pixel_space, line_space);
+
+  if (err != CE_None)
   {
-    double x = gdal_grid.x_from_cell(i);
-    double y = gdal_grid.y_from_cell(i);
-    int cell = cell_from_xy(x,y);
-    if (cell != -1) data[cell] = ((float*)gdal_buffer)[i];
+    last_error = std::string(CPLGetLastErrorMsg()); // # nocov
+    return false; // # nocov
   }
 
-  CPLFree(gdal_buffer);
-
   return true;
 }
 
@@ -439,6 +694,16 @@ bool Raster::write()
     {
       err = dataset->GetRasterBand(i)->RasterIO(GF_Write, xoffset, yoffset, ncols, nrows, &data[(i-1)*ncells], ncols, nrows, eType, 0, 0);
     }
+    else if (!circular)
+    {
+      // The buffer is skipped by giving GDAL the spacing between two lines of the full data
+      int ncols_no_buffer = ncols - 2*buffer;
+      int nrows_no_buffer = nrows - 2*buffer;
+      GSpacing pixel_space = sizeof(float);
+      GSpacing line_space = (GSpacing)ncols*sizeof(float);
+      float* first = &data[(i-1)*ncells + buffer*ncols + buffer];
+      err = dataset->GetRasterBand(i)->RasterIO(GF_Write, xoffset, yoffset, ncols_no_buffer, nrows_no_buffer, first, ncols_no_buffer, nrows_no_buffer, eType, pixel_space, line_space);
+    }
     else
     {
       //printf("There is a buffer of size %d\n", buffer);
@@ -459,13 +724,10 @@ bool Raster::write()
           float val = data[originalIndex];
 
           // Remove the buffer but the query is circular
-          if (circular)
-          {
-            float centerx = (float)ncols_no_buffer/2;
-            float centery = (float)nrows_no_buffer/2;
-            float distance = std::sqrt((new_col - centerx) * (new_col - centerx) + (new_row - centery) * (new_row - centery));
-            if (distance > buffer) val = NA_F32_RASTER;
-          }
+          float centerx = (float)ncols_no_buffer/2;
+          float centery = (float)nrows_no_buffer/2;
+          float distance = std::sqrt((new_col - centerx) * (new_col - centerx) + (new_row - centery) * (new_row - centery));
+          if (distance > buffer) val = NA_F32_RASTER;
 
           data_no_buffer[modifiedIndex] = val;
         }
@@ -4,10 +4,13 @@
 #include "GDALdataset.h"
 #include "Grid.h"
 #include "Chunk.h"
+#include "Shape.h"
 
 class Raster : public Grid, public GDALdataset
 {
 public:
+  enum FocalFunction {FOCAL_MEAN, FOCAL_MEDIAN, FOCAL_SUM, FOCAL_MIN, FOCAL_MAX};
+
   Raster();
   Raster(double xmin, double ymin, double xmax, double ymax, double res, int layers = 1);
   Raster(const Raster& raster);
@@ -16,6 +19,7 @@ public:
   bool read_file();
   void set_value(double x, double y, float value, int layer = 1);
   void set_value(int cell, float value, int layer = 1);
+  void set_triangle(const TriangleXYZ& triangle, bool overwrite = true, int layer = 1);
   bool set_nbands(int nbands);
   void set_chunk(const Chunk& chunk);
   int get_nbands() const {return nBands; };
@@ -28,7 +32,7 @@ public:
   const std::vector<float>& get_data() const { return data; };
   bool copy_data(const Raster& raster);
   const double (&get_full_extent() const)[4] { return extent; };
-  bool focal(float size, float (*operation)(std::vector<float>&));
+  bool focal(float size, int fun, int ncpu = 1);
   bool write();
   void show() const;
   float operator()(int row, int col, int layer = 1)
@@ -37,6 +41,11 @@ public:
     return get_value(cell, layer);
   }
 
+private:
+  void focal_sum(const float* in, float* out, const std::vector<int>& hw, bool mean, int ncpu) const;
+  void focal_extremum(const float* in, float* out, const std::vector<int>& hw, bool max, int ncpu) const;
+  void focal_median(const float* in, float* out, const std::vector<int>& hw, int ncpu) const;
+
 private:
   int buffer;
   bool circular;
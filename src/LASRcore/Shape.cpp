@@ -191,6 +191,40 @@ int TriangleXYZ::orientation() const
   return (val > 0) ? CLOCKWISE : COUNTERCLOCKWISE;
 }
 
+/* ====================
+ * TriangleEdges
+ * ====================*/
+
+bool TriangleEdges::init(PointXYZ A, PointXYZ B, PointXYZ C, double eps)
+{
+  double ux = B.x - A.x, uy = B.y - A.y, uz = B.z - A.z;
+  double vx = C.x - A.x, vy = C.y - A.y, vz = C.z - A.z;
+  double nz = ux*vy - uy*vx;
+  if (nz == 0) return false;
+
+  gx = -(uy*vz - uz*vy)/nz;
+  gy = -(uz*vx - ux*vz)/nz;
+  z0 = A.z - gx*A.x - gy*A.y;
+
+  if (nz < 0) std::swap(B, C);
+
+  const PointXYZ* P[4] = {&A, &B, &C, &A};
+  for (int i = 0 ; i < 3 ; i++)
+  {
+    a[i] = P[i]->y - P[i+1]->y;
+    b[i] = P[i+1]->x - P[i]->x;
+    c[i] = -(a[i]*P[i]->x + b[i]*P[i]->y);
+    tol[i] = -eps*std::sqrt(a[i]*a[i] + b[i]*b[i]);
+  }
+
+  xmin = MIN3(A.x, B.x, C.x); xmin -= eps;
+  ymin = MIN3(A.y, B.y, C.y); ymin -= eps;
+  xmax = MAX3(A.x, B.x, C.x); xmax += eps;
+  ymax = MAX3(A.y, B.y, C.y); ymax += eps;
+
+  return true;
+}
+
 /* ====================
  * Edge
  * ====================*/
@@ -133,6 +133,40 @@ private:
   enum orientation {COLINEAR, CLOCKWISE, COUNTERCLOCKWISE};
 };
 
+// Edge functions of a triangle ABC and the plane through its vertices. For an edge PQ,
+// E(x,y) = a*x + b*y + c is the signed distance to the edge times its length. The triangle is made
+// counter-clockwise so the inside is where the three functions are positive. A point at less than
+// 'eps' from an edge is inside. Used to scan convert triangles. Coordinates should be local (e.g.
+// centered on a vertex) to preserve arithmetic precision.
+struct TriangleEdges
+{
+  double a[3], b[3], c[3], tol[3];
+  double xmin, xmax, ymin, ymax;
+  double gx, gy, z0; // z = z0 + gx*x + gy*y
+
+  bool init(PointXYZ A, PointXYZ B, PointXYZ C, double eps); // false if the triangle is degenerated
+
+  inline bool contains(double x, double y) const
+  {
+    return a[0]*x + b[0]*y + c[0] >= tol[0] && a[1]*x + b[1]*y + c[1] >= tol[1] && a[2]*x + b[2]*y + c[2] >= tol[2];
+  }
+
+  // Range of x inside the triangle on the horizontal line y. Solves a*x + b*y + c >= tol for each edge
+  inline bool span(double y, double& lo, double& hi) const
+  {
+    lo = xmin;
+    hi = xmax;
+    for (int i = 0 ; i < 3 ; i++)
+    {
+      double k = tol[i] - b[i]*y - c[i];
+      if (a[i] > 0)      { if (k/a[i] > lo) lo = k/a[i]; }
+      else if (a[i] < 0) { if (k/a[i] < hi) hi = k/a[i]; }
+      else if (k > 0)    return false;
+    }
+    return lo <= hi;
+  }
+};
+
 class Sphere : public Shape3D
 {
 public:
@@ -1,5 +1,8 @@
 #include "Stage.h"
 
+#include <algorithm>
+#include <cctype>
+
 /* ==============
  *  VIRTUAL
  *  ============= */
@@ -219,6 +222,7 @@ StageRaster::StageRaster()
 StageRaster::StageRaster(const StageRaster& other) : StageWriter(other)
 {
   raster = other.raster;
+  vrt_filename = other.vrt_filename;
 }
 
 StageRaster::~StageRaster()
@@ -265,11 +269,24 @@ bool StageRaster::set_input_file_name(const std::string& file)
 // Called in the parser before any process. It assigns the name of the raster file in
 // which the data will be written. The string may contain a wildcard in this case
 // the string is a template and a new raster file is created for each chunk
+//
+// A .vrt file is a special case: each chunk is written in its own GeoTIFF file next to the
+// virtual raster (same as a template 'name_*.tif') so the chunks can be written concurrently
+// without sharing a dataset. The virtual raster is assembled at the end in sort()
 bool StageRaster::set_output_file(const std::string& file)
 {
   if (file.empty()) return true;
 
   template_filename = file;
+
+  size_t ext = file.find_last_of('.');
+  if (ext != std::string::npos && file.substr(ext) == ".vrt")
+  {
+    vrt_filename = file;
+    template_filename = file.substr(0, ext) + "_*.tif";
+    return true;
+  }
+
   size_t pos = file.find('*');
   if (pos == std::string::npos)
   {
@@ -282,6 +299,27 @@ bool StageRaster::set_output_file(const std::string& file)
   return true;
 }
 
+// Called in the parser before set_output_file(). GDAL creation options e.g. {"COMPRESS": "DEFLATE"}
+bool StageRaster::set_creation_options(const nlohmann::json& options, bool cog)
+{
+  if (!options.is_object() && !options.is_null())
+  {
+    last_error = "creation options must be a list of named options";
+    return false;
+  }
+
+  std::map<std::string, std::string> map;
+  for (const auto& [key, value] : options.items())
+  {
+    std::string name = key;
+    std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+    map[name] = (value.is_string()) ? value.get<std::string>() : value.dump();
+  }
+
+  raster.set_creation_options(map, cog);
+  return true;
+}
+
 void StageRaster::set_crs(const CRS& crs)
 {
   Stage::set_crs(crs);
@@ -292,6 +330,10 @@ bool StageRaster::write()
 {
   if (ofile.empty()) return true;
 
+  // A merged raster is a single dataset shared by all the threads. Otherwise each chunk has
+  // its own dataset and can be written without waiting for the other threads.
+  if (!merged) return raster.write();
+
   bool success;
 
   #pragma omp critical (write_raster)
@@ -302,6 +344,20 @@ bool StageRaster::write()
   return success;
 }
 
+void StageRaster::sort(const std::vector<int>& order)
+{
+  StageWriter::sort(order);
+
+  if (vrt_filename.empty() || written.empty()) return;
+
+  // The files of the chunks were closed with the private pipelines. If the virtual raster
+  // cannot be built we still return the files of the chunks
+  if (GDALdataset::build_vrt(written, vrt_filename))
+    written = {vrt_filename};
+  else
+    warning("%s\n", last_error.c_str()); // # nocov
+}
+
 /* ==============
  *  VECTOR
  * ============= */
@@ -198,11 +198,14 @@ public:
   bool set_input_file_name(const std::string& file) override;
   bool set_output_file(const std::string& file) override;
   bool write() override;
+  void sort(const std::vector<int>& order) override;
+  bool set_creation_options(const nlohmann::json& options, bool cog);
   //void clear(bool last) override;
   const Raster& get_raster() { return raster; };
 
 protected:
   Raster raster;
+  std::string vrt_filename;
 };
 
 class StageVector : public StageWriter
@@ -0,0 +1,120 @@
+#include "TDigest.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#ifndef PI
+#define PI 3.14159265358979323846
+#endif
+
+// Scale function k1 and its inverse. A centroid cannot span more than one unit of k
+static inline double k_scale(double q) { return TDigest::compression / (2*PI) * std::asin(2*q-1); }
+static inline double k_scale_inverse(double k) { return (std::sin(k * 2*PI / TDigest::compression) + 1) / 2; }
+
+TDigest::TDigest()
+{
+  nmerged = 0;
+  weight = 0;
+  min = std::numeric_limits<double>::max();
+  max = std::numeric_limits<double>::lowest();
+}
+
+void TDigest::add(double x, double w)
+{
+  centroids.push_back({x, w});
+  weight += w;
+  if (x < min) min = x;
+  if (x > max) max = x;
+
+  if (centroids.size() - nmerged >= 2*compression) compress();
+}
+
+void TDigest::merge(const TDigest& other)
+{
+  if (other.weight == 0) return;
+
+  centroids.insert(centroids.end(), other.centroids.begin(), other.centroids.end());
+  weight += other.weight;
+  if (other.min < min) min = other.min;
+  if (other.max > max) max = other.max;
+
+  if (centroids.size() - nmerged >= 2*compression) compress();
+}
+
+void TDigest::compress() const
+{
+  if (nmerged == centroids.size()) return;
+
+  std::sort(centroids.begin(), centroids.end(), [](const Centroid& a, const Centroid& b) { return a.mean < b.mean; });
+
+  size_t j = 0;
+  double cumulated = 0;
+  double limit = weight * k_scale_inverse(k_scale(0) + 1);
+  for (size_t i = 1 ; i < centroids.size() ; i++)
+  {
+    Centroid& cur = centroids[j];
+    const Centroid& next = centroids[i];
+
+    if (cumulated + cur.weight + next.weight <= limit)
+    {
+      cur.weight += next.weight;
+      cur.mean += (next.mean - cur.mean) * next.weight / cur.weight;
+    }
+    else
+    {
+      cumulated += cur.weight;
+      double k = k_scale(std::min(cumulated/weight, 1.0)) + 1;
+      limit = (k >= compression/4) ? weight : weight * k_scale_inverse(k);
+      centroids[++j] = next;
+    }
+  }
+
+  centroids.resize(j+1);
+  nmerged = centroids.size();
+}
+
+// The centroids are placed at the center of the ranks they represent and the percentile
+// is linearly interpolated between them. With unit weights (no compression) this is
+// exactly the same definition than MetricManager::percentile()
+double TDigest::quantile(double q) const
+{
+  if (weight == 0) return std::numeric_limits<double>::quiet_NaN();
+
+  // Small digests are only sorted to keep the percentiles exact
+  if (centroids.size() < 2*compression)
+  {
+    if (nmerged != centroids.size())
+    {
+      std::sort(centroids.begin(), centroids.end(), [](const Centroid& a, const Centroid& b) { return a.mean < b.mean; });
+      nmerged = centroids.size();
+    }
+  }
+  else
+  {
+    compress();
+  }
+
+  double n = weight;
+  double t = q * (n-1);
+
+  double cumulated = 0;
+  double prev_rank = 0;
+  double prev_value = min;
+  for (const auto& c : centroids)
+  {
+    double rank = cumulated + (c.weight-1)/2;
+    if (t <= rank)
+    {
+      if (rank == prev_rank) return c.mean;
+      return prev_value + (c.mean - prev_value) * (t - prev_rank) / (rank - prev_rank);
+    }
+
+    prev_rank = rank;
+    prev_value = c.mean;
+    cumulated += c.weight;
+  }
+
+  if (n-1 == prev_rank) return prev_value;
+  return prev_value + (max - prev_value) * (t - prev_rank) / (n-1 - prev_rank);
+}
@@ -0,0 +1,39 @@
+#ifndef TDIGEST_H
+#define TDIGEST_H
+
+#include <vector>
+#include <cstdint>
+
+// Merging t-digest (Dunning & Ertl). A small and mergeable sketch of the distribution of a variable
+// used to compute approximate percentiles without storing the values. The values are stored as
+// weighted centroids. Centroids are small in the tails and large in the middle of the distribution
+// so that extreme percentiles (e.g. p95, p99) are accurate. As long as there are less than
+// 2 x compression values the digest stores every value and the percentiles are exact.
+class TDigest
+{
+public:
+  TDigest();
+  void add(double x, double w = 1);
+  void merge(const TDigest& other);
+  double quantile(double q) const; // q in [0,1]
+  uint64_t size() const { return (uint64_t)weight; }
+
+  static constexpr double compression = 100;
+
+private:
+  struct Centroid
+  {
+    double mean;
+    double weight;
+  };
+
+  void compress() const;
+
+  mutable std::vector<Centroid> centroids;
+  mutable uint32_t nmerged; // the first 'nmerged' centroids are sorted
+  double weight;
+  double min;
+  double max;
+};
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef VOXELMAP_H
+#define VOXELMAP_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <limits>
+#include <utility>
+
+// Map from the 64-bit key of a pixel or a voxel to a value. It only stores the occupied cells so
+// the memory does not depend on the extent of the grid but, unlike std::unordered_map, the keys and
+// the values are stored in two flat arrays (open addressing with linear probing) so it is almost as
+// fast as a dense vector. The keys are spread with a Fibonacci hash and the table is doubled when
+// it is half full. The key UINT64_MAX is reserved.
+template <typename T>
+class VoxelMap
+{
+public:
+  VoxelMap(size_t n = 0) : count(0) { rehash(n); }
+
+  // Insert the key with the value if it does not exist. Returns false if the key already exists.
+  bool insert(uint64_t key, const T& value = T())
+  {
+    size_t i = slot(key);
+    if (keys[i] == key) return false;
+
+    if (2*(count+1) > keys.size())
+    {
+      rehash(count+1);
+      i = slot(key);
+    }
+
+    keys[i] = key;
+    values[i] = value;
+    count++;
+    return true;
+  }
+
+  T& operator[](uint64_t key)
+  {
+    insert(key);
+    return values[slot(key)];
+  }
+
+  T* find(uint64_t key)
+  {
+    size_t i = slot(key);
+    return (keys[i] == key) ? &values[i] : nullptr;
+  }
+
+  const T* find(uint64_t key) const
+  {
+    size_t i = slot(key);
+    return (keys[i] == key) ? &values[i] : nullptr;
+  }
+
+  size_t size() const { return count; }
+
+  // Direct access to the slots to iterate over the occupied cells
+  size_t capacity() const { return keys.size(); }
+  bool occupied(size_t i) const { return keys[i] != empty; }
+  uint64_t key(size_t i) const { return keys[i]; }
+  T& value(size_t i) { return values[i]; }
+  const T& value(size_t i) const { return values[i]; }
+
+private:
+  // Slot of the key or first empty slot of its probe sequence
+  size_t slot(uint64_t key) const
+  {
+    size_t mask = keys.size()-1;
+    size_t i = (key * 0x9E3779B97F4A7C15ULL) >> shift;
+    while (keys[i] != key && keys[i] != empty) i = (i+1) & mask;
+    return i;
+  }
+
+  // At least twice as many slots as n, rounded to a power of two
+  void rehash(size_t n)
+  {
+    size_t capacity = 16;
+    int bits = 4;
+    while (capacity < 2*n) { capacity *= 2; bits++; }
+    if (capacity <= keys.size()) return;
+
+    std::vector<uint64_t> old_keys(capacity, empty);
+    std::vector<T> old_values(capacity);
+    std::swap(old_keys, keys);
+    std::swap(old_values, values);
+    shift = 64 - bits;
+
+    for (size_t i = 0 ; i < old_keys.size() ; i++)
+    {
+      if (old_keys[i] == empty) continue;
+      size_t j = slot(old_keys[i]);
+      keys[j] = old_keys[i];
+      values[j] = std::move(old_values[i]);
+    }
+  }
+
+private:
+  static constexpr uint64_t empty = std::numeric_limits<uint64_t>::max();
+  std::vector<uint64_t> keys;
+  std::vector<T> values;
+  size_t count;
+  int shift;
+};
+
+#endif
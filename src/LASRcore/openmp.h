@@ -1,3 +1,6 @@
+#ifndef OPENMP_H
+#define OPENMP_H
+
 #ifdef _OPENMP
 #include <omp.h>
 #else
@@ -5,8 +8,40 @@
 #define omp_get_thread_num() 0
 #define omp_get_max_threads() 1
 #define omp_get_thread_limit() 1
+#define omp_in_parallel() 0
 #define omp_set_max_active_levels(x)
 #endif
 
+#include <algorithm>
+#include <cstdint>
+
 int available_threads();
-bool has_omp_support();
\ No newline at end of file
+bool has_omp_support();
+
+// Parallel loop shared by the stages. When called from a chunk processed by the task scheduler
+// of process() (concurrent-files and nested strategies) we are already in an active parallel
+// region. The loop is thus split into tasks that any idle thread of the team can pick up. This way
+// threads that have no more chunks to process help the chunks that are still running. Otherwise,
+// it opens its own parallel region with ncpu threads. The loop body is copied once per thread or
+// per task such as any object captured by value behaves like a firstprivate variable.
+template<typename F>
+void parallel_for(int64_t n, int ncpu, F body)
+{
+#if defined(_OPENMP) && _OPENMP >= 201511
+  if (omp_in_parallel())
+  {
+    int64_t ntasks = std::min<int64_t>(n, 8*omp_get_num_threads());
+    if (ntasks < 1) ntasks = 1;
+
+    #pragma omp taskloop num_tasks(ntasks) firstprivate(body)
+    for (int64_t i = 0 ; i < n ; ++i) body(i);
+
+    return;
+  }
+#endif
+
+  #pragma omp parallel for num_threads(ncpu) firstprivate(body)
+  for (int64_t i = 0 ; i < n ; ++i) body(i);
+}
+
+#endif
@@ -20,11 +20,13 @@
 #include "nothing.h"
 #include "pitfill.h"
 #include "rasterize.h"
+#include "rasterizetin.h"
 #include "sampling.h"
 #include "readlas.h"
 #include "readpcd.h"
 #include "regiongrowing.h"
 #include "setcrs.h"
+#include "smrf.h"
 #include "sor.h"
 #include "sort.h"
 #include "summary.h"
@@ -87,6 +89,7 @@ bool Pipeline::parse(const nlohmann::json& json, bool progress)
     {"add_rgb",              create_instance<LASRaddrgb>},
     {"classify_with_csf",    create_instance<LASRcsf>},
     {"classify_with_ivf",    create_instance<LASRivf>},
+    {"classify_with_smrf",   create_instance<LASRsmrf>},
     {"classify_with_sor",    create_instance<LASRsor>},
     {"filter",               create_instance<LASRfilter>},
     {"filter_grid",          create_instance<LASRfiltergrid>},
@@ -100,6 +103,7 @@ bool Pipeline::parse(const nlohmann::json& json, bool progress)
     {"nothing",              create_instance<LASRnothing>},
     {"pit_fill",             create_instance<LASRpitfill>},
     {"rasterize",            create_instance<LASRrasterize>},
+    {"rasterize_tin",        create_instance<LASRrasterizetin>},
     {"sampling_pixel",       create_instance<LASRsamplingpixels>},
     {"sampling_poisson",     create_instance<LASRsamplingpoisson>},
     {"sampling_voxel",       create_instance<LASRsamplingvoxels>},
@@ -488,6 +492,14 @@ bool Pipeline::parse(const nlohmann::json& json, bool progress)
         current_crs = p->get_crs();
         p->set_filter(filters);
 
+        // GDAL creation options of raster files
+        StageRaster* r = dynamic_cast<StageRaster*>(p);
+        if (r && (stage.contains("creation_options") || stage.contains("cog")))
+        {
+          if (!r->set_creation_options(stage.value("creation_options", nlohmann::json::object()), stage.value("cog", false)))
+            return false;
+        }
+
         // Create empty files that will be filled later during the processing
         if (!p->set_output_file(output)) return false;
 
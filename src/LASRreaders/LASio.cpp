@@ -6,6 +6,7 @@
 #include "laszip_decompress_selective_v3.hpp"
 #include "lasindex.hpp"
 #include "lasquadtree.hpp"
+#include "lasinterval.hpp"
 
 LASio::LASio()
 {
@@ -568,6 +569,39 @@ bool LASio::write_lax(const std::string& file, bool overwrite, bool embedded)
   return true;
 }
 
+// Reads the cells of the quadtree of the spatial index (lax file) with the number of points they
+// contain. This gives a cheap estimation of the spatial distribution of the points without reading them.
+bool LASio::get_index_cells(std::vector<Rectangle>& cells, std::vector<uint64_t>& counts)
+{
+  if (lasreader == nullptr)
+  {
+    last_error = "Internal error. LASreader not initialized."; // # nocov
+    return false; // # nocov
+  }
+
+  LASindex* index = lasreader->get_index();
+  if (index == nullptr) return false;
+
+  LASquadtree* spatial = index->get_spatial();
+  LASinterval* interval = index->get_interval();
+  if (spatial == nullptr || interval == nullptr) return false; // # nocov
+
+  while (interval->has_cells())
+  {
+    U32 level = spatial->get_level((U32)interval->index);
+    U32 level_index = spatial->get_level_index((U32)interval->index, level);
+
+    F64 min[2];
+    F64 max[2];
+    spatial->get_cell_bounding_box(level_index, level, min, max);
+
+    cells.emplace_back(min[0], min[1], max[0], max[1]);
+    counts.push_back(interval->full);
+  }
+
+  return true;
+}
+
 bool LASio::is_opened()
 {
   return (lasreader != nullptr || laswriter != nullptr);
@@ -31,6 +31,7 @@ public:
   bool read_point(Point* p);
   bool write_point(Point* p);
   bool write_lax(const std::string& file, bool overwrite, bool embedded);
+  bool get_index_cells(std::vector<Rectangle>& cells, std::vector<uint64_t>& counts);
   bool is_opened();
   void close();
   void reset_accessor();
@@ -32,7 +32,7 @@ bool LASRaggregate::process(PointCloud*& las)
 {
   // Pre-compute the groups for each point
   std::vector<int> cells;
-  while (las->read_point(true)) // Need to include withheld points to do not mess grouper indexes
+  while (las->read_point())
   {
     double x = las->point.get_x();
     double y = las->point.get_y();
@@ -42,10 +42,12 @@ bool LASRaggregate::process(PointCloud*& las)
     else
       cells.push_back(raster.cell_from_xy(x,y));
 
-    grouper.insert(cells);
+    grouper.insert(las->get_index(&las->point), cells);
     cells.clear();
   }
 
+  grouper.group(raster.get_ncells());
+
   int error = 0;  // Error handling
   int nattr = las->header->schema.attributes.size();
   int nalloc = grouper.largest_group_size();   // Size of the largest group (i.e. the pixel with most numerous points)
@@ -90,31 +92,31 @@ bool LASRaggregate::process(PointCloud*& las)
   }
 
   // Loop through each group on which we want to apply the call
-  auto map = grouper.map;
-
   progress->reset();
   progress->set_prefix("Rasterize");
-  progress->set_total(map.size());
+  progress->set_total(grouper.size());
+
+  Point p;
+  p.set_schema(&las->header->schema);
 
-  for (const auto& pair : map)
+  for (size_t k = 0 ; k < grouper.size() ; k++)
   {
-    int group = pair.first;
-    las->set_intervals_to_read(pair.second);
+    int group = grouper.get_key(k);
 
-    // Read the points of the query and populate the list
+    // Read the points of the group and populate the list
     int j = 0;
-    while (las->read_point())
+    for (const int* it = grouper.begin(k) ; it != grouper.end(k) ; it++)
     {
-      if (pointfilter.filter(&las->point)) continue;
+      if (!las->get_point(*it, &p, &pointfilter)) continue;
 
       for (int i = 0 ; i < Rf_length(list) ; i++)
       {
         SEXP vector = VECTOR_ELT(list, i);
 
         if (sexp_types[i] == REALSXP)
-          REAL(vector)[j] = accessors[i](&las->point);
+          REAL(vector)[j] = accessors[i](&p);
         else
-          INTEGER(vector)[j] = accessors[i](&las->point);
+          INTEGER(vector)[j] = accessors[i](&p);
       }
 
       j++;
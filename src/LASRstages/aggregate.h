@@ -4,7 +4,7 @@
 #ifdef USING_R
 
 #include "Stage.h"
-#include "GridPartition.h" // Must create a file Grouper
+#include "Grouper.h"
 
 class LASRaggregate: public StageRaster
 {
@@ -32,7 +32,7 @@ private:
   SEXP call;
   SEXP env;
 
-  Grouper grouper;
+  CellGrouper grouper;
 
   enum attributes{X, Y, Z, I, T, RN, NOR, SDF, EoF, CLASS, SYNT, KEYP, WITH, OVER, UD, SA, PSID, R, G, B, NIR, CHAN};
 };
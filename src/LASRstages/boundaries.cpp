@@ -1,8 +1,6 @@
 #include "boundaries.h"
 #include "triangulate.h"
 
-#include <unordered_set>
-#include <unordered_map>
 #include <algorithm>
 
 bool LASRboundaries::set_parameters(const nlohmann::json& stage)
@@ -51,39 +49,7 @@ bool LASRboundaries::process(PointCloud*& las)
     return false; // # nocov
   }
 
-  std::vector<Edge> edges;
-  std::unordered_map<PointXY, PointXY> unordered_contour;
-
-  p->contour(edges);
-
-  for (const auto& v : edges)
-  {
-    unordered_contour.insert({v.A, v.B});
-  }
-
-  edges.clear();
-  edges.shrink_to_fit();
-
-  while (!unordered_contour.empty())
-  {
-    PointXY p;
-    PolygonXY ordered_contour;
-
-    auto it = unordered_contour.cbegin();
-
-    do
-    {
-      ordered_contour.push_back(it->first);
-      p = it->second;
-      unordered_contour.erase(it);
-      it = unordered_contour.find(p);
-
-    } while(it != unordered_contour.end());
-
-    ordered_contour.close();
-
-    contour.push_back(ordered_contour);
-  }
+  if (!p->contour(contour)) return false;
 
   // Sort the vector using is_clockwise such as the outer ring comes first to we spec compliant
   std::sort(contour.begin(), contour.end(), [](const PolygonXY& a, const PolygonXY& b) {
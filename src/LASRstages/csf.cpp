@@ -11,23 +11,6 @@ bool LASRcsf::process(PointCloud*& las)
   progress->set_prefix("CSF");
   progress->show();
 
-  std::vector<csf::Point> points;
-  points.reserve(las->npoints);
-
-  AttributeAccessor set_and_get_classification("Classification");
-
-  while(las->read_point())
-  {
-    if (pointfilter.filter(&las->point)) continue;
-
-    csf::Point p;
-    p.x = las->point.get_x();
-    p.y = las->point.get_y();
-    p.z = las->point.get_z();
-    if (set_and_get_classification(&las->point) == (double)classification) set_and_get_classification(&las->point, 0);
-    points.push_back(p);
-  }
-
   CSF csf;
   csf.params.bSloopSmooth = slope_smooth;
   csf.params.class_threshold = class_threshold;
@@ -36,23 +19,41 @@ bool LASRcsf::process(PointCloud*& las)
   csf.params.rigidness = rigidness;
   csf.params.time_step = time_step;
   csf.ncpu = ncpu;
-  csf.setPointCloud(points);
 
-  std::vector<int> ground, nonground;
-  csf.do_filtering(ground, nonground, false);
+  // The points are written directly in the cloth coordinate system (x, -z, y) without
+  // intermediate copy. 'ids' records which point of the point cloud each one is.
+  csf::PointCloud& points = csf.getPointCloud();
+  points.reserve(las->npoints);
+  std::vector<int> ids;
+  ids.reserve(las->npoints);
 
-  int i = 0;
-  int k = 0;
-  while(las->read_point())
+  Point p;
+  p.set_schema(&las->header->schema);
+  for (size_t i = 0 ; i < las->npoints ; i++)
   {
-    if (pointfilter.filter(&las->point)) continue;
+    if (!las->get_point(i, &p, &pointfilter)) continue;
+    points.emplace_back(p.get_x(), -p.get_z(), p.get_y());
+    ids.push_back(i);
+  }
 
-    if (i == ground[k])
+  std::vector<char> ground;
+  csf.do_filtering(ground);
+
+  AttributeAccessor set_and_get_classification("Classification");
+
+  for (size_t k = 0 ; k < ids.size() ; k++)
+  {
+    las->get_point(ids[k], &p);
+    double c = set_and_get_classification(&p);
+
+    if (ground[k])
     {
-      k++;
-      if (set_and_get_classification(&las->point) != 9) set_and_get_classification(&las->point, classification);
+      if (c != 9) set_and_get_classification(&p, classification);
+    }
+    else if (c == (double)classification)
+    {
+      set_and_get_classification(&p, 0);
     }
-    i++;
   }
 
   return true;
@@ -1,8 +1,5 @@
 #include "focal.h"
 
-#include <algorithm>
-#include <numeric>
-
 bool LASRfocal::set_parameters(const nlohmann::json& stage)
 {
   size = stage.at("size");
@@ -16,15 +13,15 @@ bool LASRfocal::set_parameters(const nlohmann::json& stage)
   std::string method = stage.value("fun", "mean");
 
   if (method == "mean")
-    operation = mean;
+    operation = Raster::FOCAL_MEAN;
   else if (method == "median")
-    operation = median;
+    operation = Raster::FOCAL_MEDIAN;
   else if (method == "sum")
-    operation = sum;
+    operation = Raster::FOCAL_SUM;
   else if (method == "min")
-    operation = min;
+    operation = Raster::FOCAL_MIN;
   else if (method == "max")
-    operation = max;
+    operation = Raster::FOCAL_MAX;
   else
   {
     last_error = std::string("Unknown operation: ") + method;
@@ -57,39 +54,7 @@ bool LASRfocal::process()
 
   const Raster& rin = p->get_raster();
   if (!raster.copy_data(rin)) return false;
-  raster.focal(size, operation);
-
-  return true;
-}
-
-float LASRfocal::mean(std::vector<float>& vals)
-{
-  return std::accumulate(vals.begin(), vals.end(), 0.0f) / vals.size();
-}
-
-float LASRfocal::median(std::vector<float>& vals)
-{
-  std::sort(vals.begin(), vals.end());
-
-  if (vals.size() % 2 == 0)
-    return (vals[vals.size() / 2 - 1] + vals[vals.size() / 2]) / 2;
-  else
-    return vals[vals.size() / 2];
-}
-
-float LASRfocal::sum(std::vector<float>& vals)
-{
-  return std::accumulate(vals.begin(), vals.end(), 0.0f);
-}
-
-float LASRfocal::min(std::vector<float>& vals)
-{
-  return *std::min_element(vals.begin(), vals.end());
-}
-
-float LASRfocal::max(std::vector<float>& vals)
-{
-  return *std::max_element(vals.begin(), vals.end());
+  return raster.focal(size, operation, ncpu);
 }
 
 bool LASRfocal::connect(const std::list<std::unique_ptr<Stage>>& pipeline, const std::string& uid)
@@ -18,12 +18,7 @@ public:
 
 private:
   float size;
-  float (*operation)(std::vector<float>&);
-  static float mean(std::vector<float>& vals);
-  static float median(std::vector<float>& vals);
-  static float sum(std::vector<float>& vals);
-  static float min(std::vector<float>& vals);
-  static float max(std::vector<float>& vals);
+  int operation;
 };
 
 #endif
\ No newline at end of file
@@ -1,15 +1,17 @@
 #include "ivf.h"
-#include "Grid.h"
+#include "openmp.h"
 
-#include <unordered_map>
+#include <algorithm>
+#include <limits>
 
+// The points are counted per occupied voxel by sorting the keys of their voxels. The key
+// x + y*nx + z*nx*ny orders the voxels by row (y, z) and by x within a row. The number of points
+// in the 26 neighbours of a voxel is the sum of the counts of three consecutive voxels in the nine
+// neighbouring rows minus its own count. For a given row offset the neighbouring keys increase with
+// the key of the voxel so each of the nine rows is swept with a cursor that only moves forward.
+// The memory is proportional to the number of occupied voxels.
 bool LASRivf::process(PointCloud*& las)
 {
-  // Stores for a given voxel the number of point in its 27 voxels neighborhood
-  std::unordered_map<Voxel, int, VoxelHash> uregistry;
-  std::vector<int> vregistry;
-  bool use_vregistry = false;
-
   double rxmin = las->header->min_x;
   double rymin = las->header->min_y;
   double rzmin = las->header->min_z;
@@ -27,62 +29,96 @@ bool LASRivf::process(PointCloud*& las)
   int length = (rxmax - rxmin) / res;
   int width  = (rymax - rymin) / res;
   int height = (rzmax - rzmin) / res;
-  size_t nvoxels = (size_t)length*(size_t)width*(size_t)height;
-
-  if (!force_map && nvoxels < INT_MAX/sizeof(int)) // 256 MB
-  {
-    vregistry.resize(nvoxels);
-    std::fill(vregistry.begin(), vregistry.end(), 0);
-    use_vregistry = true;
-  }
 
   progress->reset();
   progress->set_total(las->npoints*2);
   progress->set_prefix("Isolated voxels");
 
-  Voxel ukey;
-  int vkey;
+  // Key of the voxel of a point. The voxels outside the grid have no neighbours.
+  const uint64_t none = std::numeric_limits<uint64_t>::max();
+  auto voxel_key = [&](const Point& p) -> uint64_t
+  {
+    int nx = std::floor((p.get_x() - rxmin) / res);
+    int ny = std::floor((p.get_y() - rymin) / res);
+    int nz = std::floor((p.get_z() - rzmin) / res);
+
+    if (nx < 0 || nx >= length || ny < 0 || ny >= width || nz < 0 || nz >= height)
+      return none;
+
+    return (uint64_t)nx + (uint64_t)ny*length + (uint64_t)nz*length*width;
+  };
+
+  std::vector<uint64_t> voxels;
+  voxels.reserve(las->npoints);
 
   while (las->read_point())
   {
-    int nx = std::floor((las->point.get_x() - rxmin) / res);
-    int ny = std::floor((las->point.get_y() - rymin) / res);
-    int nz = std::floor((las->point.get_z() - rzmin) / res);
+    uint64_t key = voxel_key(las->point);
+    if (key != none) voxels.push_back(key);
+
+    progress->update(las->current_point);
+    if (progress->interrupted()) return true;
+  }
+
+  // Occupied voxels and their number of points
+  std::sort(voxels.begin(), voxels.end());
+
+  std::vector<int> counts;
+  size_t nvoxels = 0;
+  for (size_t i = 0 ; i < voxels.size() ; )
+  {
+    size_t j = i;
+    while (j < voxels.size() && voxels[j] == voxels[i]) j++;
+    voxels[nvoxels++] = voxels[i];
+    counts.push_back(j-i);
+    i = j;
+  }
+  voxels.resize(nvoxels);
+  voxels.shrink_to_fit();
+
+  // Number of points in the 26 neighbours of each occupied voxel. The voxels are split in blocks
+  // processed in parallel. Each block positions its nine cursors with a binary search.
+  std::vector<int> neighbours(nvoxels, 0);
+  const size_t block = 4096;
+  size_t nblocks = (nvoxels + block - 1) / block;
+
+  parallel_for(nblocks, ncpu, [&](int64_t b)
+  {
+    size_t first = b*block;
+    size_t last = std::min(first + block, nvoxels);
 
-    // Add one in the 27 neighboring voxels of this point
-    for (int i : {-1,0,1})
+    for (int dz : {-1,0,1})
     {
-      for (int j : {-1,0,1})
+      for (int dy : {-1,0,1})
       {
-        for (int k : {-1,0,1})
+        int64_t offset = (int64_t)dy*length + (int64_t)dz*length*width;
+        int64_t start = (int64_t)voxels[first] + offset - 1;
+        size_t cursor = (start <= 0) ? 0 : std::lower_bound(voxels.begin(), voxels.end(), (uint64_t)start) - voxels.begin();
+
+        for (size_t v = first ; v < last ; v++)
         {
-          if (i == 0 && j == 0 && k == 0)
+          uint64_t key = voxels[v];
+          int nx = key % length;
+          int ny = (key / length) % width;
+          int nz = key / ((uint64_t)length*width);
+
+          if (ny+dy < 0 || ny+dy >= width || nz+dz < 0 || nz+dz >= height)
             continue;
 
-          int xi = nx+i;
-          int yj = ny+j;
-          int zk = nz+k;
-
-          if (xi < 0 || xi >= length || yj < 0 || yj >= width || zk < 0 || zk >= height)
-            continue; // This happens on the edges
-
-          if (use_vregistry)
-          {
-            vkey = xi + yj*length + zk*length*width;
-            vregistry[vkey]++;
-          }
-          else
-          {
-            ukey = {xi, yj, zk};
-            uregistry[ukey]++;
-          }
+          uint64_t lo = key + offset - (nx > 0 ? 1 : 0);
+          uint64_t hi = key + offset + (nx < length-1 ? 1 : 0);
+
+          while (cursor < nvoxels && voxels[cursor] < lo) cursor++;
+
+          for (size_t c = cursor ; c < nvoxels && voxels[c] <= hi ; c++)
+            neighbours[v] += counts[c];
         }
       }
     }
 
-    progress->update(las->current_point);
-    if (progress->interrupted()) break;
-  }
+    for (size_t v = first ; v < last ; v++)
+      neighbours[v] -= counts[v];
+  });
 
   AttributeAccessor set_and_get_classification("Classification");
 
@@ -90,21 +126,13 @@ bool LASRivf::process(PointCloud*& las)
   // Check if the number of points in its neighbourhood is above the threshold
   while (las->read_point())
   {
-    int nx = std::floor((las->point.get_x() - rxmin) / res);
-    int ny = std::floor((las->point.get_y() - rymin) / res);
-    int nz = std::floor((las->point.get_z() - rzmin) / res);
+    uint64_t key = voxel_key(las->point);
 
-    int count;
-
-    if (use_vregistry)
-    {
-      vkey = nx + ny*length + nz*length*width;
-      count = vregistry[vkey] ;
-    }
-    else
+    int count = 0;
+    if (key != none)
     {
-      ukey = {nx, ny, nz};
-      count = uregistry[ukey];
+      size_t v = std::lower_bound(voxels.begin(), voxels.end(), key) - voxels.begin();
+      count = neighbours[v];
     }
 
     if (count < n)
@@ -124,6 +152,5 @@ bool LASRivf::set_parameters(const nlohmann::json& stage)
   res = stage.value("res", 5.0);
   n = stage.value("n", 6);
   classification = stage.value("class", 18);
-  force_map = stage.value("force_map", false);
   return true;
 }
@@ -19,8 +19,6 @@ private:
   double res;
   int n;
   int classification;
-  bool force_map;
-
 };
 
 #endif
\ No newline at end of file
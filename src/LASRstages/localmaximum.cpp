@@ -2,17 +2,33 @@
 #include "openmp.h"
 
 #include <chrono>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <atomic>
 
 LASRlocalmaximum::LASRlocalmaximum()
 {
   this->use_raster = false;
-  this->counter = std::make_shared<unsigned int>(0);
-  this->unicity_table = std::make_shared<std::unordered_map<uint64_t, unsigned int>>();
+  this->unicity_table = std::make_shared<UnicityTable>();
 }
 
 bool LASRlocalmaximum::set_parameters(const nlohmann::json& stage)
 {
   ws = stage.at("ws");
+
+  // Variable window size given as a table of heights and window sizes
+  if (stage.contains("ws_heights"))
+  {
+    ws_heights = ::get_vector<double>(stage["ws_heights"]);
+    ws_values = ::get_vector<double>(stage["ws_values"]);
+    if (ws_heights.size() != ws_values.size() || ws_heights.size() < 2)
+    {
+      last_error = "invalid table of window sizes";
+      return false;
+    }
+    ws = *std::max_element(ws_values.begin(), ws_values.end());
+  }
   min_height = stage.value("min_height", 2.0);
 
   use_attribute = stage.value("use_attribute", "Z");
@@ -44,18 +60,252 @@ bool LASRlocalmaximum::process()
   StageRaster* p = dynamic_cast<StageRaster*>(it->second);
   const Raster& raster = p->get_raster();
 
-  // Convert the raster to a LAS object to recycle the point cloud based local maximum
-  PointCloud las(raster);
-  PointCloud* ptr = &las;
+  return process(raster);
+}
+
+// Local maximum filter working directly on the grid. The cells are quantized exactly like the
+// points of PointCloud(raster) so the maxima and their FIDs are the same than the point cloud based
+// filter applied to the converted raster. Each cell visits its neighbours from the closest to the
+// farthest and stops at the first higher one, which is usually adjacent. The cells that have an
+// equal neighbour are resolved afterwards in cell order such that the first one wins.
+bool LASRlocalmaximum::process(const Raster& raster)
+{
+  AttributeAccessor get_intensity("Intensity");
+  AttributeAccessor get_angle("Angle");
+  AttributeAccessor get_return("ReturnNumber");
+  AttributeAccessor get_number("NumberOfReturns");
+
+  auto start_time = std::chrono::high_resolution_clock::now();
+
+  int ncols = raster.get_ncols();
+  int nrows = raster.get_nrows();
+  int ncells = raster.get_ncells();
+  if (ncells == 0) return true;
+
+  // Same schema than PointCloud(raster)
+  AttributeSchema schema;
+  schema.add_attribute("Flags", AttributeType::INT8);
+  schema.add_attribute("X", AttributeType::INT32, 0.001, (int)raster.get_full_extent()[0]);
+  schema.add_attribute("Y", AttributeType::INT32, 0.001, (int)raster.get_full_extent()[1]);
+  schema.add_attribute("Z", AttributeType::INT32, 0.001, 0);
+  Point pp(&schema);
+
+  // Quantized coordinates of the columns and rows
+  std::vector<double> qx(ncols), qy(nrows);
+  std::vector<int> qX(ncols), qY(nrows);
+  for (int col = 0 ; col < ncols ; col++) { pp.set_x(raster.x_from_col(col)); qx[col] = pp.get_x(); qX[col] = pp.get_X(); }
+  for (int row = 0 ; row < nrows ; row++) { pp.set_y(raster.y_from_row(row)); qy[row] = pp.get_y(); qY[row] = pp.get_Y(); }
+
+  // Quantized values. The cells that are not points (NA or filtered) get the lowest value.
+  const int missing = std::numeric_limits<int>::min();
+  std::vector<int> Z(ncells, missing);
+  for (int i = 0 ; i < ncells ; i++)
+  {
+    float z = raster.get_value(i);
+    if (raster.is_na(z)) continue;
+
+    pp.set_x(raster.x_from_cell(i));
+    pp.set_y(raster.y_from_cell(i));
+    pp.set_z(z);
+    if (pointfilter.filter(&pp)) continue;
+
+    Z[i] = pp.get_Z();
+  }
+
+  const Attribute& attrz = schema.attributes[AttributeCore::Z];
+  auto value = [&](int Zi) { return attrz.scale_factor * Zi + attrz.value_offset; };
+
+  // Neighbourhood of the largest window sorted by distance. The coordinates are rounded so the
+  // exact test is done on the quantized coordinates with a margin on the nominal distance.
+  struct Offset { int drow, dcol; double d2; };
+  double xres = raster.get_xres();
+  double yres = raster.get_yres();
+  double tol = 0.01;
+  double rmax = ws/2 + tol;
+  int nx = (int)(rmax / xres) + 1;
+  int ny = (int)(rmax / yres) + 1;
+  std::vector<Offset> offsets;
+  for (int drow = -ny ; drow <= ny ; drow++)
+  {
+    for (int dcol = -nx ; dcol <= nx ; dcol++)
+    {
+      if (drow == 0 && dcol == 0) continue;
+      double d2 = (dcol*xres)*(dcol*xres) + (drow*yres)*(drow*yres);
+      if (d2 <= rmax*rmax) offsets.push_back({drow, dcol, d2});
+    }
+  }
+  std::sort(offsets.begin(), offsets.end(), [](const Offset& a, const Offset& b) { return a.d2 < b.d2; });
+
+  std::vector<char> status(ncells, NLM);
+
+  progress->reset();
+  progress->set_total(nrows);
+  progress->set_prefix("Local maximum");
+  progress->set_ncpu(ncpu);
+
+  // The next for loop is at the level 2 of a nested parallel region. Printing the progress bar
+  // is not thread safe. We first check that we are in outer thread 0
+  bool main_thread = omp_get_thread_num() == 0;
+
+  parallel_for(nrows, ncpu, [&](int64_t row)
+  {
+    if (progress->interrupted()) return;
+
+    if (main_thread)
+    {
+      #pragma omp critical
+      {
+        // can only be called in outer thread 0 AND is internally thread safe being called only in outer thread 0
+        (*progress)++;
+        progress->show();
+      }
+    }
+
+    for (int col = 0 ; col < ncols ; col++)
+    {
+      int cell = row*ncols + col;
+      int Zc = Z[cell];
+      if (Zc == missing) continue;
+
+      double v = value(Zc);
+      if (v < min_height) continue;
+
+      double x = qx[col];
+      double y = qy[row];
+      double r = window(v)/2;
+      double r2 = r*r;
+      double lim = (r + tol)*(r + tol);
+
+      char state = LMX;
+      for (const auto& o : offsets)
+      {
+        if (o.d2 > lim) break;
 
-  // Process the LAS
-  use_raster = false; // deactivate to process a LAS
-  bool success = process(ptr);
-  use_raster = true;
+        int nrow = row + o.drow;
+        int ncol = col + o.dcol;
+        if (nrow < 0 || nrow >= nrows || ncol < 0 || ncol >= ncols) continue;
 
-  return success;
+        int Zn = Z[nrow*ncols + ncol];
+        if (Zn < Zc) continue;
+
+        // Same test than Circle::contains()
+        double sx = qx[ncol];
+        double sy = qy[nrow];
+        if ((x - sx)*(x - sx) + (y - sy)*(y - sy) >= r2) continue;
+        if (Zn > Zc) { state = NLM; break; }
+        if (sx != x || sy != y) state = TIE;
+      }
+
+      status[cell] = state;
+    }
+  });
+
+  progress->done();
+
+  // Cells with an equal neighbour in their window. The equal neighbours with a lower index are
+  // already resolved.
+  for (int cell = 0 ; cell < ncells ; cell++)
+  {
+    if (status[cell] != TIE) continue;
+
+    int row = cell / ncols;
+    int col = cell % ncols;
+    int Zc = Z[cell];
+    double x = qx[col];
+    double y = qy[row];
+    double r = window(value(Zc))/2;
+    double r2 = r*r;
+    double lim = (r + tol)*(r + tol);
+
+    status[cell] = LMX;
+    for (const auto& o : offsets)
+    {
+      if (o.d2 > lim) break;
+
+      int nrow = row + o.drow;
+      int ncol = col + o.dcol;
+      if (nrow < 0 || nrow >= nrows || ncol < 0 || ncol >= ncols) continue;
+
+      int n = nrow*ncols + ncol;
+      if (n > cell || Z[n] != Zc || status[n] != LMX) continue;
+
+      double sx = qx[ncol];
+      double sy = qy[nrow];
+      if (sx == x && sy == y) continue;
+      if ((x - sx)*(x - sx) + (y - sy)*(y - sy) < r2) { status[cell] = NLM; break; }
+    }
+  }
+
+  for (int cell = 0 ; cell < ncells ; cell++)
+  {
+    if (status[cell] != LMX) continue;
+
+    int row = cell / ncols;
+    int col = cell % ncols;
+    pp.set_X(qX[col]);
+    pp.set_Y(qY[row]);
+    pp.set_Z(Z[cell]);
+
+    // Same 64 bits geographic ID than the point cloud based filter
+    uint64_t FID = ((uint64_t)pp.get_X() << 32) | (uint64_t)(pp.get_Y());
+
+    PointLAS plas;
+    plas.x = pp.get_x();
+    plas.y = pp.get_y();
+    plas.z = pp.get_z();
+    plas.intensity = get_intensity(&pp);
+    plas.return_number = get_return(&pp);
+    plas.scan_angle = get_angle(&pp);
+    plas.number_of_returns = get_number(&pp);
+    plas.FID = unicity_table->get_id(FID);
+    lm.push_back(plas);
+  }
+
+  if (verbose)
+  {
+    // # nocov start
+    auto end_time = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
+    float second = (float)duration.count()/1000.0f;
+    print("  Local Maximum Filter took %.2f sec.\n", second);
+    // # nocov end
+  }
+
+  return true;
+}
+
+unsigned int UnicityTable::get_id(uint64_t key)
+{
+  // Fibonacci hashing: the high bits of the product depend on every bit of the key
+  Shard& shard = shards[(key * 0x9E3779B97F4A7C15ULL) >> 58];
+
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.ids.find(key);
+  if (it != shard.ids.end()) return it->second;
+
+  unsigned int id = counter.fetch_add(1, std::memory_order_relaxed);
+  shard.ids.emplace(key, id);
+  return id;
 }
 
+// Diameter of the window for a given height. Piecewise linear interpolation of a table of
+// windows if the window size is variable, constant otherwise.
+double LASRlocalmaximum::window(double z) const
+{
+  if (ws_heights.empty()) return ws;
+  if (z <= ws_heights.front()) return ws_values.front();
+  if (z >= ws_heights.back()) return ws_values.back();
+  size_t k = std::upper_bound(ws_heights.begin(), ws_heights.end(), z) - ws_heights.begin();
+  double t = (z - ws_heights[k-1]) / (ws_heights[k] - ws_heights[k-1]);
+  return ws_values[k-1] + t * (ws_values[k] - ws_values[k-1]);
+}
+
+// The points are copied once and bucketed in a fine grid that records the highest value of each
+// cell. The candidates are visited by decreasing height. A cell entirely inside the window of a
+// candidate with a higher value rejects it without looking at any point, and only the cells that
+// cross the circle are checked point by point. A local maximum tags the lower points of its window
+// so they are skipped. A point that has an equal neighbour is only resolved at the end, in the
+// order of the points, such that the first one wins as in a sequential run.
 bool LASRlocalmaximum::process(PointCloud*& las)
 {
   if (use_raster) return true;
@@ -72,29 +322,116 @@ bool LASRlocalmaximum::process(PointCloud*& las)
   AttributeAccessor get_return("ReturnNumber");
   AttributeAccessor get_number("NumberOfReturns");
 
+  auto start_time = std::chrono::high_resolution_clock::now();
+
+  // The points that are neighbours: not withheld and not filtered
+  std::vector<int> fid;
+  std::vector<double> px, py, pv;
+  double bxmin = std::numeric_limits<double>::max();
+  double bymin = std::numeric_limits<double>::max();
+  double bxmax = std::numeric_limits<double>::lowest();
+  double bymax = std::numeric_limits<double>::lowest();
+  double rmin = std::numeric_limits<double>::max();
+
+  Point pp;
+  pp.set_schema(&las->header->schema);
+  for (size_t i = 0 ; i < las->npoints ; i++)
+  {
+    if (!las->get_point(i, &pp, &pointfilter)) continue;
+    double x = pp.get_x();
+    double y = pp.get_y();
+    double v = accessor(&pp);
+    fid.push_back(i);
+    px.push_back(x);
+    py.push_back(y);
+    pv.push_back(v);
+    bxmin = std::min(bxmin, x);
+    bymin = std::min(bymin, y);
+    bxmax = std::max(bxmax, x);
+    bymax = std::max(bymax, y);
+    if (v >= min_height) rmin = std::min(rmin, window(v)/2);
+  }
+
+  size_t n = fid.size();
+  if (n == 0 || rmin == std::numeric_limits<double>::max()) return true;
+
+  // Grid of cells half the size of the smallest window radius, but not much more cells than points
+  double res = rmin/2;
+  double area = (bxmax - bxmin + res) * (bymax - bymin + res);
+  if (area / (res*res) > 4.0*n + 1024) res = std::sqrt(area / (4.0*n + 1024));
+  int ncols = (int)((bxmax - bxmin) / res) + 1;
+  int nrows = (int)((bymax - bymin) / res) + 1;
+  size_t ncells = (size_t)ncols * nrows;
+
+  auto col_of = [&](double x) { return std::min(ncols-1, std::max(0, (int)((x - bxmin) / res))); };
+  auto row_of = [&](double y) { return std::min(nrows-1, std::max(0, (int)((y - bymin) / res))); };
+
+  // Counting sort of the points by cell. Coordinates and values are stored in cell order
+  std::vector<size_t> offsets(ncells + 1, 0);
+  std::vector<size_t> cell(n);
+  for (size_t k = 0 ; k < n ; k++)
+  {
+    cell[k] = (size_t)row_of(py[k]) * ncols + col_of(px[k]);
+    offsets[cell[k] + 1]++;
+  }
+  for (size_t c = 0 ; c < ncells ; c++) offsets[c+1] += offsets[c];
+
+  std::vector<int> order(n);
+  std::vector<size_t> pos(offsets.begin(), offsets.end() - 1);
+  for (size_t k = 0 ; k < n ; k++) order[pos[cell[k]]++] = k;
+  cell.clear();
+  cell.shrink_to_fit();
+  pos.clear();
+  pos.shrink_to_fit();
+
+  std::vector<double> sx(n), sy(n), sv(n);
+  std::vector<int> sid(n);
+  std::vector<double> cellmax(ncells, -std::numeric_limits<double>::infinity());
+  for (size_t k = 0 ; k < n ; k++)
+  {
+    int o = order[k];
+    sx[k] = px[o];
+    sy[k] = py[o];
+    sv[k] = pv[o];
+    sid[k] = fid[o];
+  }
+  px.clear(); px.shrink_to_fit();
+  py.clear(); py.shrink_to_fit();
+  pv.clear(); pv.shrink_to_fit();
+  fid.clear(); fid.shrink_to_fit();
+
+  for (size_t c = 0 ; c < ncells ; c++)
+  {
+    for (size_t k = offsets[c] ; k < offsets[c+1] ; k++)
+      cellmax[c] = std::max(cellmax[c], sv[k]);
+  }
+
+  // Candidates by decreasing value, then by increasing point index
+  for (size_t k = 0 ; k < n ; k++) order[k] = k;
+  order.erase(std::remove_if(order.begin(), order.end(), [&](int k) { return sv[k] < min_height; }), order.end());
+  std::sort(order.begin(), order.end(), [&](int a, int b) { return (sv[a] != sv[b]) ? sv[a] > sv[b] : sid[a] < sid[b]; });
+
+  // A task marks the lower points of its window as non maxima while other tasks read and write
+  // their own status. The result does not depend on the interleaving (a point marked NLM has a higher
+  // point in its window and would find it itself) but the accesses must be atomic. Relaxed accesses
+  // are enough: no other memory is published through 'status'.
+  std::vector<std::atomic<char>> status(n);
+  auto get_status = [&](size_t i) { return status[i].load(std::memory_order_relaxed); };
+  auto set_status = [&](size_t i, char value) { status[i].store(value, std::memory_order_relaxed); };
+  for (size_t k = 0 ; k < n ; k++) set_status(k, UKN);
+
   progress->reset();
-  progress->set_total(las->npoints);
+  progress->set_total(order.size());
   progress->set_prefix("Local maximum");
   progress->set_ncpu(ncpu);
 
-  // Local maximum algorithm
-  double hws = ws/2;
-  std::vector<char> status(las->npoints);
-  std::fill(status.begin(), status.end(), UKN);
-
-  auto start_time = std::chrono::high_resolution_clock::now();
-
   // The next for loop is at the level 2 of a nested parallel region. Printing the progress bar
   // is not thread safe. We first check that we are in outer thread 0
   bool main_thread = omp_get_thread_num() == 0;
 
-  #pragma omp parallel for num_threads(ncpu)
-  for (size_t i = 0 ; i < las->npoints ; ++i)
+  parallel_for(order.size(), ncpu, [&](int64_t i)
   {
-    if (progress->interrupted()) continue;
-
-    Point pp;
-    pp.set_schema(&las->header->schema);
+    if (progress->interrupted()) return;
 
     if (main_thread)
     {
@@ -106,55 +443,101 @@ bool LASRlocalmaximum::process(PointCloud*& las)
       }
     }
 
-    if (!las->get_point(i, &pp, &pointfilter)) { status[i] = NLM; } // The point was either filtered or withhelded
-    if (accessor(&pp) < min_height) { status[i] = NLM; }
-    if (status[i] == NLM) continue;
+    int k = order[i];
+    if (get_status(k) == NLM) return;
+
+    double x = sx[k];
+    double y = sy[k];
+    double v = sv[k];
+    double r = window(v)/2;
+    double r2 = r*r;
 
-    Circle windows(pp.get_x(), pp.get_y(), hws);
-    std::vector<Point> points;
-    las->query(&windows, points, &pointfilter);
+    int c0 = col_of(x - r), c1 = col_of(x + r);
+    int r0 = row_of(y - r), r1 = row_of(y + r);
 
-    // It seems there is a data race here but no. In the worst case updating status[pt.FID]
-    // is non-synchronized with other iterations and it will simply prevent skipping one computation early
-    for (auto& pt : points)
+    // A cell with a higher value entirely inside the window
+    for (int row = r0 ; row <= r1 ; row++)
     {
-      int fid = las->get_index(&pt);
-      if (accessor(&pt) == accessor(&pp) && (pt.get_x() != pp.get_x() || pt.get_y() != pp.get_y()) && status[fid] == LMX) status[i] = NLM; // Handle duplicated height for different points
-      if (accessor(&pt) > accessor(&pp)) status[i] = NLM;  // If the point is above the central one, the central one is not a LM
-      if (accessor(&pt) < accessor(&pp)) status[fid] = NLM; // If the point is below the central we can pretag it as not a LM (no data race)
+      double ya = bymin + row*res - y;
+      double yb = ya + res;
+      double dy = std::max(ya*ya, yb*yb);
+      for (int col = c0 ; col <= c1 ; col++)
+      {
+        size_t c = (size_t)row * ncols + col;
+        if (cellmax[c] <= v || offsets[c] == offsets[c+1]) continue;
+        double xa = bxmin + col*res - x;
+        double xb = xa + res;
+        double dx = std::max(xa*xa, xb*xb);
+        if (dx + dy < r2 * (1 - 1e-9))
+        {
+          set_status(k, NLM);
+          return;
+        }
+      }
     }
 
-    if (status[i] == UKN) status[i] = LMX; // If the status is still unknown it is a local max
+    // A higher point in the cells that cross the circle. Same test than Circle::contains()
+    bool tie = false;
+    for (int row = r0 ; row <= r1 ; row++)
+    {
+      for (int col = c0 ; col <= c1 ; col++)
+      {
+        size_t c = (size_t)row * ncols + col;
+        if (cellmax[c] < v) continue;
+        for (size_t j = offsets[c] ; j < offsets[c+1] ; j++)
+        {
+          if (sv[j] < v) continue;
+          if ((x - sx[j])*(x - sx[j]) + (y - sy[j])*(y - sy[j]) >= r2) continue;
+          if (sv[j] > v) { set_status(k, NLM); return; }
+          if (sx[j] != x || sy[j] != y) tie = true;
+        }
+      }
+    }
 
-    if (status[i] == LMX)
+    set_status(k, tie ? TIE : LMX);
+
+    // The lower points that have this point in their own window are not local maxima
+    for (int row = r0 ; row <= r1 ; row++)
     {
-      #pragma omp critical(assign_lm_ids)
+      for (int col = c0 ; col <= c1 ; col++)
       {
-        // If the point is in the buffer we must guarantee it will be assigned the same ID the next
-        // time we meet it. FID is a 64 bit geographic ID that is guaranteed to be unique. But we need
-        // a 32 bit ID so we have a correspondence table.
-        uint64_t FID = ((uint64_t)pp.get_X() << 32) | (uint64_t)(pp.get_Y());
-        auto it = unicity_table->find(FID);
-
-        PointLAS plas;
-        plas.x = pp.get_x();
-        plas.y = pp.get_y();
-        plas.z = pp.get_z();
-        plas.intensity = get_intensity(&pp);
-        plas.return_number = get_return(&pp);
-        plas.scan_angle = get_angle(&pp);
-        plas.number_of_returns = get_number(&pp);
-        if (it == unicity_table->end())
+        size_t c = (size_t)row * ncols + col;
+        for (size_t j = offsets[c] ; j < offsets[c+1] ; j++)
         {
-          (*unicity_table)[FID] = *counter;
-          lm.push_back(plas);
-          lm.back().FID = *counter;
-          (*counter)++;
+          if (sv[j] >= v || sv[j] < min_height || get_status(j) != UKN) continue;
+          double d2 = (x - sx[j])*(x - sx[j]) + (y - sy[j])*(y - sy[j]);
+          double rj = window(sv[j])/2;
+          if (d2 < rj*rj) set_status(j, NLM);
         }
-        else
+      }
+    }
+  });
+
+  // Points with an equal neighbour in their window. The first one (by point index) that is a local
+  // maximum wins. The order of the candidates guarantees that the equal neighbours with a lower
+  // index are already resolved.
+  for (int k : order)
+  {
+    if (get_status(k) != TIE) continue;
+
+    double x = sx[k];
+    double y = sy[k];
+    double v = sv[k];
+    double r = window(v)/2;
+    double r2 = r*r;
+
+    set_status(k, LMX);
+
+    for (int row = row_of(y - r) ; row <= row_of(y + r) && get_status(k) == LMX ; row++)
+    {
+      for (int col = col_of(x - r) ; col <= col_of(x + r) && get_status(k) == LMX ; col++)
+      {
+        size_t c = (size_t)row * ncols + col;
+        for (size_t j = offsets[c] ; j < offsets[c+1] ; j++)
         {
-          lm.push_back(plas);
-          lm.back().FID = it->second;
+          if (sv[j] != v || sid[j] >= sid[k] || get_status(j) != LMX) continue;
+          if (sx[j] == x && sy[j] == y) continue;
+          if ((x - sx[j])*(x - sx[j]) + (y - sy[j])*(y - sy[j]) < r2) { set_status(k, NLM); break; }
         }
       }
     }
@@ -162,6 +545,33 @@ bool LASRlocalmaximum::process(PointCloud*& las)
 
   progress->done();
 
+  // Local maxima in the order of the points
+  std::vector<int> maxima;
+  for (int k : order) if (get_status(k) == LMX) maxima.push_back(sid[k]);
+  std::sort(maxima.begin(), maxima.end());
+
+  lm.reserve(lm.size() + maxima.size());
+  for (int i : maxima)
+  {
+    las->get_point(i, &pp);
+
+    // If the point is in the buffer we must guarantee it will be assigned the same ID the next
+    // time we meet it. FID is a 64 bit geographic ID that is guaranteed to be unique. But we need
+    // a 32 bit ID so we have a correspondence table.
+    uint64_t FID = ((uint64_t)pp.get_X() << 32) | (uint64_t)(pp.get_Y());
+
+    PointLAS plas;
+    plas.x = pp.get_x();
+    plas.y = pp.get_y();
+    plas.z = pp.get_z();
+    plas.intensity = get_intensity(&pp);
+    plas.return_number = get_return(&pp);
+    plas.scan_angle = get_angle(&pp);
+    plas.number_of_returns = get_number(&pp);
+    plas.FID = unicity_table->get_id(FID);
+    lm.push_back(plas);
+  }
+
   if (verbose)
   {
     // # nocov start
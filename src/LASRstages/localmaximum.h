@@ -8,6 +8,27 @@
 #include <vector>
 #include <unordered_map>
 #include <memory>
+#include <mutex>
+#include <atomic>
+
+// Correspondence table between the 64-bit geographic key of a local maximum and its 32-bit ID,
+// shared by the clones of the stage. The keys are spread over shards that have their own lock and
+// the IDs are drawn from an atomic counter, so concurrent files almost never wait for each other.
+class UnicityTable
+{
+public:
+  unsigned int get_id(uint64_t key);
+
+private:
+  static constexpr int nshards = 64;
+  struct Shard
+  {
+    std::mutex mutex;
+    std::unordered_map<uint64_t, unsigned int> ids;
+  };
+  Shard shards[nshards];
+  std::atomic<unsigned int> counter{0};
+};
 
 class LASRlocalmaximum : public StageVector
 {
@@ -28,20 +49,25 @@ public:
   // multi-threading
   LASRlocalmaximum* clone() const override { return new LASRlocalmaximum(*this); };
 
+private:
+  bool process(const Raster& raster);
+  double window(double z) const;
+
 private:
   bool use_raster;
   bool record_attributes;
 
   double ws;
+  std::vector<double> ws_heights;
+  std::vector<double> ws_values;
   double min_height;
 
   std::string use_attribute;
   std::vector<PointLAS> lm;
 
-  std::shared_ptr<unsigned int> counter;
-  std::shared_ptr<std::unordered_map<uint64_t, unsigned int>> unicity_table;
+  std::shared_ptr<UnicityTable> unicity_table;
 
-  enum states {UKN, NLM, LMX};
+  enum states {UKN, NLM, LMX, TIE};
 };
 
 #endif
\ No newline at end of file
@@ -57,10 +57,9 @@ bool LASRnnmetrics::process(PointCloud*& las)
 
   lm.resize(maxima.size());
 
-  #pragma omp parallel for num_threads(ncpu) firstprivate(metrics)
-  for (size_t i = 0 ; i < maxima.size() ; i++)
+  parallel_for(maxima.size(), ncpu, [&, metrics = metrics, vals = std::vector<float>()](int64_t i) mutable
   {
-    if (progress->interrupted()) continue;
+    if (progress->interrupted()) return;
 
     const PointLAS& p = maxima[i];
 
@@ -80,12 +79,8 @@ bool LASRnnmetrics::process(PointCloud*& las)
     }
 
     PointXYZAttrs pt(p.x, p.y, p.z);
-    pt.vals.reserve(metrics.size());
-    for (int i = 0 ; i < metrics.size() ; i++)
-    {
-      float val = metrics.get_metric(i, pts);
-      pt.vals.push_back(val);
-    }
+    metrics.get_metrics(pts, vals);
+    pt.vals.assign(vals.begin(), vals.end());
 
     lm[i] = pt;
 
@@ -97,7 +92,7 @@ bool LASRnnmetrics::process(PointCloud*& las)
         progress->show();
       }
     }
-  }
+  });
 
   progress->done();
 
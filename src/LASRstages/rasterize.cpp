@@ -46,7 +46,6 @@ bool LASRrasterize::process(Point*& p)
 
   double x = p->get_x();
   double y = p->get_y();
-  double z = p->get_z();
 
   std::vector<int> cells;
   if (window)
@@ -54,12 +53,20 @@ bool LASRrasterize::process(Point*& p)
   else
     cells.push_back(raster.cell_from_xy(x,y));
 
-  for (int i = 0 ; i < metric_engine.size() ; ++i)
+  bool accumulate = metric_engine.need_accumulators();
+
+  for (int cell : cells)
   {
-    for (int cell : cells)
+    if (cell < 0 || cell >= raster.get_ncells()) continue;
+
+    // Metrics such as mean or sd are accumulated and computed in finalize()
+    if (accumulate) metric_engine.accumulate(cell, p);
+
+    // Metrics such as max or min are folded in the raster
+    for (int i = 0 ; i < metric_engine.size() ; ++i)
     {
       float v = raster.get_value(cell, i+1);
-      float res = metric_engine.get_metric(i, v, z);
+      float res = metric_engine.get_metric(i, v, p);
       raster.set_value(cell, res, i+1);
     }
   }
@@ -67,6 +74,47 @@ bool LASRrasterize::process(Point*& p)
   return true;
 }
 
+// Streamed metrics computed from the accumulators are written in the raster once all the points
+// have been processed. finalize() can be called several times.
+void LASRrasterize::finalize()
+{
+  if (!streamable || !metric_engine.need_accumulators()) return;
+
+  for (int cell = 0 ; cell < raster.get_ncells() ; cell++)
+  {
+    for (int i = 0 ; i < metric_engine.size() ; ++i)
+    {
+      float v = raster.get_value(cell, i+1);
+      float res = metric_engine.get_metric(i, cell, v);
+      if (res != v) raster.set_value(cell, res, i+1);
+    }
+  }
+}
+
+bool LASRrasterize::set_chunk(Chunk& chunk)
+{
+  if (!StageRaster::set_chunk(chunk)) return false;
+
+  if (streamable)
+  {
+    metric_engine.reset();
+    if (metric_engine.need_accumulators()) metric_engine.init_accumulators(raster.get_ncells());
+  }
+
+  return true;
+}
+
+bool LASRrasterize::write()
+{
+  finalize();
+  return StageRaster::write();
+}
+
+void LASRrasterize::clear(bool last)
+{
+  metric_engine.clear_accumulators();
+}
+
 bool LASRrasterize::process(PointCloud*& las)
 {
   // Streamable metrics:
@@ -80,6 +128,7 @@ bool LASRrasterize::process(PointCloud*& las)
       if (!process(p))
         return false; // # nocov
     }
+    finalize();
     return true;
   }
 
@@ -95,17 +144,15 @@ bool LASRrasterize::process(PointCloud*& las)
       return false; // # nocov
     }
 
-    std::vector<double> z;
-    if (!p->interpolate(z, &raster)) return false;
-    for (auto i = 0 ; i < raster.get_ncells() ; i++) raster.set_value(i, (float)z[i]);
-    return true;
+    return p->interpolate(raster);
   }
 
   // Last option:
   // we rasterize metrics that are not streamable  (code partially from aggregate)
-  Grouper grouper;
+  // The points are counting sorted by cell so each cell is a contiguous span of point indexes
+  CellGrouper grouper;
   std::vector<int> cells;
-  while (las->read_point(true)) // Need to include withheld points to do not mess grouper indexes
+  while (las->read_point())
   {
     double x = las->point.get_x();
     double y = las->point.get_y();
@@ -115,30 +162,13 @@ bool LASRrasterize::process(PointCloud*& las)
     else
       cells.push_back(raster.cell_from_xy(x,y));
 
-    grouper.insert(cells);
+    grouper.insert(las->get_index(&las->point), cells);
     cells.clear();
   }
 
-  // Loop through each group on which we want to apply the call
-  auto map = grouper.map;
+  grouper.group(raster.get_ncells());
 
-  progress->reset();
-  progress->set_prefix("Rasterize");
-  progress->set_total(map.size());
-  progress->set_ncpu(ncpu);
-  progress->show();
-
-  // OpenMP cannot parallelize on a map. Create vectors to hold keys and references to corresponding vectors
-  size_t n = grouper.map.size();
-  std::vector<int> keys;
-  std::vector<std::vector<Interval>*> intervals;
-  keys.reserve(n);
-  intervals.reserve(n);
-  for (auto& pair : grouper.map)
-  {
-    keys.push_back(pair.first);
-    intervals.push_back(&pair.second);
-  }
+  size_t n = grouper.size();
 
   progress->reset();
   progress->set_total(n);
@@ -153,20 +183,17 @@ bool LASRrasterize::process(PointCloud*& las)
   // Next calls, all touch a different cell and are thus thread safe
   raster.set_value(0, NA_F32_RASTER, 1);
 
-  #pragma omp parallel for num_threads(ncpu) firstprivate(metric_engine)
-  for (size_t i = 0; i < n; ++i)
+  // The metric engine is captured by copy and is thus private to each thread
+  parallel_for(n, ncpu, [&, engine = metric_engine, vals = std::vector<float>(), pts = std::vector<Point>()](int64_t i) mutable
   {
-    if (progress->interrupted()) continue;
+    if (progress->interrupted()) return;
 
-    std::vector<Point> pts;
-    int cell = keys[i];
-    las->query(*intervals[i], pts, &pointfilter);
+    int cell = grouper.get_key(i);
+    las->query(grouper.begin(i), grouper.end(i), pts, &pointfilter);
 
-    for (int i = 0 ; i < metric_engine.size() ; i++)
-    {
-      float val = metric_engine.get_metric(i, pts);
-      raster.set_value(cell, val, i+1);
-    }
+    engine.get_metrics(pts, vals);
+    for (int i = 0 ; i < engine.size() ; i++)
+      raster.set_value(cell, vals[i], i+1);
 
     if (main_thread)
     {
@@ -177,7 +204,7 @@ bool LASRrasterize::process(PointCloud*& las)
         progress->show();
       }
     }
-  }
+  });
 
   progress->done();
 
@@ -11,6 +11,9 @@ public:
   LASRrasterize() = default;
   bool process(Point*& p) override;
   bool process(PointCloud*& las) override;
+  bool set_chunk(Chunk& chunk) override;
+  bool write() override;
+  void clear(bool last) override;
   double need_buffer() const override { return MAX(raster.get_xres(), window); };
   bool is_streamable() const override { return streamable; };
   bool is_parallelized() const override { return !streamable; };
@@ -21,6 +24,9 @@ public:
   // multi-threading
   LASRrasterize* clone() const override { return new LASRrasterize(*this); };
 
+private:
+  void finalize();
+
 private:
   std::vector<std::string> methods;
   bool streamable;
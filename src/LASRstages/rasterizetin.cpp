@@ -0,0 +1,273 @@
+#include "rasterizetin.h"
+#include "Delaunay.h"
+#include "Shape.h"
+#include "openmp.h"
+
+#include "delaunator/delaunator.hpp"
+
+#include <cmath>
+#include <limits>
+
+using delaunator::INVALID_INDEX;
+
+static inline size_t next_halfedge(size_t e) { return (e % 3 == 2) ? e - 2 : e + 1; }
+static inline uint64_t edge_key(size_t a, size_t b) { return ((uint64_t)a << 32) | (uint64_t)b; }
+
+LASRrasterizetin::LASRrasterizetin()
+{
+  trim = 0;
+  band = 0;
+  yfinal = std::numeric_limits<double>::infinity();
+}
+
+bool LASRrasterizetin::set_parameters(const nlohmann::json& stage)
+{
+  double res = stage.at("res");
+  double max_edge = stage.value("max_edge", 0.0);
+  use_attribute = stage.value("use_attribute", "Z");
+
+  trim = max_edge*max_edge;
+  accessor = AttributeAccessor(use_attribute);
+  raster = Raster(xmin, ymin, xmax, ymax, res, 1);
+
+  return true;
+}
+
+bool LASRrasterizetin::set_chunk(Chunk& chunk)
+{
+  if (!StageRaster::set_chunk(chunk)) return false;
+  reset();
+  return true;
+}
+
+bool LASRrasterizetin::process(Point*& p)
+{
+  if (p->get_deleted() != 0) return true;
+  if (pointfilter.filter(p)) return true;
+
+  double x = p->get_x();
+  double y = p->get_y();
+
+  // Same bands than sort_points(). A point exactly on the limit between two bands may have been
+  // sorted in any of them. It is assigned to the upper one, which is always safe.
+  if (band == 0) band = 50 * crs.get_linear_units();
+  double ytop = (std::floor(y / band) + 1) * band;
+
+  if (y > yfinal)
+  {
+    last_error = "the points are not spatially sorted. Use sort_points() first";
+    return false;
+  }
+
+  if (ytop < yfinal)
+  {
+    finalize(ytop);
+    yfinal = ytop;
+  }
+
+  coords.push_back(x);
+  coords.push_back(y);
+  zs.push_back(accessor(p));
+
+  return true;
+}
+
+bool LASRrasterizetin::process(PointCloud*& las)
+{
+  Point* p;
+  while (las->read_point())
+  {
+    p = &las->point;
+    if (!process(p))
+      return false;
+  }
+
+  return true;
+}
+
+bool LASRrasterizetin::write()
+{
+  // Every remaining triangle is final
+  finalize(-std::numeric_limits<double>::infinity());
+  reset();
+  return StageRaster::write();
+}
+
+void LASRrasterizetin::clear(bool last)
+{
+  reset();
+}
+
+void LASRrasterizetin::reset()
+{
+  band = 0;
+  yfinal = std::numeric_limits<double>::infinity();
+  coords.clear();
+  coords.shrink_to_fit();
+  zs.clear();
+  zs.shrink_to_fit();
+  border.clear();
+  accessor.reset();
+}
+
+// Triangulates the active points, rasterizes the triangles that are final given that the next
+// points are below 'ylim' and keeps only the points that may still be connected to new points.
+// The points of the final area that were discarded leave a hole in the triangulation that is filled
+// with fake triangles. The directed edges of the boundary of the final area are edges of every
+// future triangulation because their triangle has an empty circumcircle. The triangles on the same
+// side than the final triangle are fake, the other ones are not. The labels are propagated to the
+// triangles connected without crossing a boundary edge.
+void LASRrasterizetin::finalize(double ylim)
+{
+  bool last = std::isinf(ylim) && ylim < 0;
+
+  size_t n = zs.size();
+  if (n < 3) return;
+
+  std::vector<size_t> triangles;
+  std::vector<size_t> halfedges;
+  try
+  {
+    Delaunay d(coords, ncpu);
+    triangles = std::move(d.triangles);
+    halfedges = std::move(d.halfedges);
+  }
+  catch (...)
+  {
+    // All the points are collinear. Everything is kept for the next band.
+    return;
+  }
+
+  size_t ntri = triangles.size()/3;
+
+  // Fake triangles
+  enum : char { UNKNOWN = 0, FAKE = 1, REAL = 2 };
+  std::vector<char> label(ntri, UNKNOWN);
+  std::vector<char> is_border(triangles.size(), 0);
+  bool valid = true;
+
+  if (!border.empty())
+  {
+    for (size_t e = 0 ; e < triangles.size() ; e++)
+    {
+      char l = UNKNOWN;
+      if (border.count(edge_key(triangles[e], triangles[next_halfedge(e)]))) l = FAKE;
+      else if (border.count(edge_key(triangles[next_halfedge(e)], triangles[e]))) l = REAL;
+      if (l == UNKNOWN) continue;
+
+      is_border[e] = 1;
+      if (label[e/3] != UNKNOWN && label[e/3] != l) valid = false;
+      label[e/3] = l;
+    }
+
+    std::vector<size_t> stack;
+    for (size_t t = 0 ; t < ntri ; t++)
+    {
+      if (label[t] == UNKNOWN) continue;
+
+      stack.push_back(t);
+      while (!stack.empty())
+      {
+        size_t u = stack.back();
+        stack.pop_back();
+        for (size_t e = 3*u ; e < 3*u+3 ; e++)
+        {
+          size_t twin = halfedges[e];
+          if (twin == INVALID_INDEX || is_border[e]) continue;
+          size_t v = twin/3;
+          if (label[v] == UNKNOWN) { label[v] = label[u]; stack.push_back(v); }
+          else if (label[v] != label[u]) valid = false;
+        }
+      }
+    }
+
+    // Cocircular points on the boundary may give another triangulation of the boundary. The labels
+    // are not reliable but the raster is only written where it is still empty. This only prevents
+    // the fake triangles to fill the holes left by the trimmed triangles.
+    if (!valid) std::fill(label.begin(), label.end(), UNKNOWN);
+  }
+
+  // Final triangles: nothing below 'ylim' can be in the circumcircle
+  double margin = 1e-6 * band;
+  std::vector<char> is_final(ntri, 0);
+  for (size_t t = 0 ; t < ntri ; t++)
+  {
+    if (label[t] == FAKE) continue;
+    if (last) { is_final[t] = 1; continue; }
+
+    const size_t* v = &triangles[3*t];
+    double ax = coords[2*v[0]], ay = coords[2*v[0]+1];
+    double dx = coords[2*v[1]] - ax, dy = coords[2*v[1]+1] - ay;
+    double ex = coords[2*v[2]] - ax, ey = coords[2*v[2]+1] - ay;
+    double bl = dx*dx + dy*dy;
+    double cl = ex*ex + ey*ey;
+    double k = 0.5 / (dx*ey - dy*ex);
+    double cx = (ey*bl - dy*cl)*k;
+    double cy = (dx*cl - ex*bl)*k;
+    double r = std::sqrt(cx*cx + cy*cy);
+    cy += ay;
+
+    is_final[t] = std::isfinite(r) && cy - r > ylim + margin;
+  }
+
+  // Rasterization of the final triangles. The cells already written are not overwritten so a
+  // triangle cannot erase a previous band. The memory is allocated on the first band before the
+  // parallel loop (set_triangle() is not thread safe when it allocates).
+  if (raster.get_data().empty()) raster.set_value(0, raster.get_nodata(), 1);
+
+  parallel_for(ntri, ncpu, [&](int64_t t)
+  {
+    if (!is_final[t]) return;
+
+    const size_t* v = &triangles[3*t];
+    TriangleXYZ triangle(PointXYZ(coords[2*v[0]], coords[2*v[0]+1], zs[v[0]]),
+                         PointXYZ(coords[2*v[1]], coords[2*v[1]+1], zs[v[1]]),
+                         PointXYZ(coords[2*v[2]], coords[2*v[2]+1], zs[v[2]]));
+
+    if (trim > 0 && triangle.square_max_edge_size() > trim) return;
+
+    raster.set_triangle(triangle, false);
+  });
+
+  if (last) return;
+
+  // The points of the triangles that are not final and the convex hull are kept
+  std::vector<size_t> newid(n, INVALID_INDEX);
+  for (size_t e = 0 ; e < triangles.size() ; e++)
+  {
+    size_t t = e/3;
+    bool keep = (label[t] != FAKE && !is_final[t]) || halfedges[e] == INVALID_INDEX;
+    if (keep)
+    {
+      newid[triangles[e]] = 0;
+      newid[triangles[next_halfedge(e)]] = 0;
+    }
+  }
+
+  size_t m = 0;
+  for (size_t i = 0 ; i < n ; i++)
+  {
+    if (newid[i] == INVALID_INDEX) continue;
+    newid[i] = m;
+    coords[2*m] = coords[2*i];
+    coords[2*m+1] = coords[2*i+1];
+    zs[m] = zs[i];
+    m++;
+  }
+
+  coords.resize(2*m);
+  zs.resize(m);
+
+  // New boundary of the final area: edges of the final area (fake or final) that are adjacent to
+  // a triangle that is not final or to the outside.
+  border.clear();
+  for (size_t e = 0 ; e < triangles.size() ; e++)
+  {
+    size_t t = e/3;
+    if (label[t] != FAKE && !is_final[t]) continue;
+
+    size_t twin = halfedges[e];
+    bool outside = (twin == INVALID_INDEX) || (label[twin/3] != FAKE && !is_final[twin/3]);
+    if (outside) border.insert(edge_key(newid[triangles[e]], newid[triangles[next_halfedge(e)]]));
+  }
+}
@@ -0,0 +1,46 @@
+#ifndef LASRRASTERIZETIN_H
+#define LASRRASTERIZETIN_H
+
+#include "Stage.h"
+
+#include <unordered_set>
+
+// Streamed Delaunay triangulation interpolated into a raster. The points must be spatially sorted
+// in horizontal bands from north to south (see sort_points()). When a point enters a new band,
+// the points are triangulated and every triangle whose circumcircle is entirely above the band
+// cannot be modified by the next points: it is a triangle of the final triangulation. It is
+// rasterized immediately and its vertices are discarded unless they belong to a triangle that is
+// not final yet or to the convex hull. Only the points of the current band and of the front are
+// held in memory.
+class LASRrasterizetin : public StageRaster
+{
+public:
+  LASRrasterizetin();
+  bool process(Point*& p) override;
+  bool process(PointCloud*& las) override;
+  bool set_chunk(Chunk& chunk) override;
+  bool write() override;
+  void clear(bool last) override;
+  bool is_streamable() const override { return true; };
+  bool set_parameters(const nlohmann::json&) override;
+  std::string get_name() const override { return "rasterize_tin"; };
+
+  // multi-threading
+  LASRrasterizetin* clone() const override { return new LASRrasterizetin(*this); };
+
+private:
+  void finalize(double ylim);
+  void reset();
+
+private:
+  double trim;
+  double band;
+  double yfinal;                     // the triangles above this line are final
+  std::string use_attribute;
+  AttributeAccessor accessor;
+  std::vector<double> coords;        // [x0, y0, x1, y1, ...] of the active points
+  std::vector<double> zs;
+  std::unordered_set<uint64_t> border; // directed edges of the boundary of the final area
+};
+
+#endif
@@ -2,8 +2,8 @@
 #include "localmaximum.h"
 #include "Shape.h"
 
-#include <array>
-#include <unordered_map>
+#include <algorithm>
+#include <map>
 
 #include <ctime>
 
@@ -90,29 +90,45 @@ bool LASRregiongrowing::process(PointCloud*& las)
   struct Region
   {
     PointXYZ top;
-    std::vector<int> cells;
+    int npixels;
     unsigned int FID;
     double sum_height;
+    std::vector<int> front; // cells that may still grow, in the order they were added
 
-    int npixels() { return cells.size(); };
-    double mean_height() { return sum_height/npixels(); };
+    double mean_height() { return sum_height/npixels; };
   };
 
   std::map<int, Region> regions;
   for (const auto& pt : lm)
   {
     int cell = raster.cell_from_xy(pt.x, pt.y);
+    if (cell < 0) continue;
     raster.set_value(cell, pt.FID);
     Region region;
     region.top = pt;
-    region.cells.push_back(cell);
+    region.npixels = 1;
+    region.front.push_back(cell);
     region.FID = pt.FID;
     region.sum_height = image.get_value(cell);
     regions[cell] = region;
   }
 
+  std::vector<Region*> growing;
+  for (auto& pair : regions) growing.push_back(&pair.second);
+
+  int nrows = raster.get_nrows();
+  int ncols = raster.get_ncols();
+  float nodata = raster.get_nodata();
+
+  // Each pass visits the regions in the order of their seeds and the cells of each region in the
+  // order they were added, and a cell added during a pass is only expanded at the next pass. This
+  // is the original algorithm. But a cell is visited again only if one of its neighbours may still
+  // be added. A neighbour that is already assigned, that is too far from the seed, too low or too
+  // high will never be added. Only a neighbour rejected by the mean height of the crown, which
+  // varies while the region grows, may be added later. Thus each pass only visits the front of
+  // the regions instead of every cell of every region.
   bool grown = false;
-  std::array<Pixel, 4> neighbours;
+  std::vector<int> next;
 
   do
   {
@@ -120,47 +136,68 @@ bool LASRregiongrowing::process(PointCloud*& las)
 
     grown = false;
 
-    for (auto& pair : regions)        // Loops across all regions
+    for (Region* region : growing)
     {
-      Region& region = pair.second;
+      next.clear();
+      std::vector<int> added;
 
-      int n = region.cells.size();
-      for(int k = 0 ; k < n ; k++)     // Loop across all cells of a region
-      {
-        int cell = region.cells[k];
+      double hSeed = region->top.z;                     // Seed height
+      double threshold2 = hSeed+hSeed*0.05;
 
-        double hSeed = region.top.z;           // Seed height
-        double mhCrown= region.mean_height();  // Mean height of the crown
+      for (int cell : region->front)                    // Loop across the front of the region
+      {
+        double mhCrown = region->mean_height();         // Mean height of the crown
+        double threshold1 = MIN(hSeed*th_seed, mhCrown*th_crown);
 
-        auto neighbours = raster.get_adjacent_cells(cell, Grid::ROOK);
+        int row = cell / ncols;
+        int col = cell % ncols;
+        bool retry = false;
 
-        for(unsigned int i = 0 ; i < neighbours.size() ; i++) // For each neighbouring pixel
+        // Same order than Grid::get_adjacent_cells(ROOK)
+        const int drow[4] = {-1, 0, 0, 1};
+        const int dcol[4] = {0, -1, 1, 0};
+        for (int i = 0 ; i < 4 ; i++)                   // For each neighbouring pixel
         {
-          int cell = neighbours[i];
-          if (raster.get_value(cell) != raster.get_nodata()) continue;
+          int r = row + drow[i];
+          int c = col + dcol[i];
+          if (r < 0 || r >= nrows || c < 0 || c >= ncols) continue;
+
+          int neighbour = r*ncols + c;
+          if (raster.get_value(neighbour) != nodata) continue;
 
-          float val = image.get_value(cell);
-          double threshold1 = MIN(hSeed*th_seed, mhCrown*th_crown);
-          double threshold2 = hSeed+hSeed*0.05;
-          double x = raster.x_from_cell(cell);
-          double y = raster.y_from_cell(cell);
-          double sqdistance = (x-region.top.x)*(x-region.top.x) + (y-region.top.y)*(y-region.top.y);
+          float val = image.get_value(neighbour);
+          double x = raster.x_from_cell(neighbour);
+          double y = raster.y_from_cell(neighbour);
+          double sqdistance = (x-region->top.x)*(x-region->top.x) + (y-region->top.y)*(y-region->top.y);
 
-          bool expend = (val > threshold1) && (val <= threshold2) && (sqdistance < DIST) && (val > th_tree);
+          bool possible = (val <= threshold2) && (sqdistance < DIST) && (val > th_tree);
+          if (!possible) continue;
 
-          if (expend)                                     // The pixel in part of the region
+          if (val > threshold1)                         // The pixel in part of the region
           {
-            raster.set_value(cell, (float)region.FID);    // Assign the ID to the output raster
-            region.cells.push_back(cell);                 // Add the pixel to the region
-            region.sum_height += image.get_value(cell);   // Update the sum of the height of the region
+            raster.set_value(neighbour, (float)region->FID); // Assign the ID to the output raster
+            added.push_back(neighbour);                 // Add the pixel to the region
+            region->npixels++;
+            region->sum_height += val;                  // Update the sum of the height of the region
             grown = true;
             (*progress)++;
           }
+          else
+          {
+            retry = true;
+          }
         }
+
+        if (retry) next.push_back(cell);
       }
 
+      next.insert(next.end(), added.begin(), added.end());
+      region->front.swap(next);
+
       progress->show();
     }
+
+    growing.erase(std::remove_if(growing.begin(), growing.end(), [](Region* r) { return r->front.empty(); }), growing.end());
   }
   while (grown);
 
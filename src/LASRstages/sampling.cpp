@@ -1,18 +1,12 @@
 #include "sampling.h"
 #include "Grid.h"
+#include "VoxelMap.h"
 #include "openmp.h"
 
-#include <unordered_map>
-#include <unordered_set>
-
 /*
- * Comment on computing strategies. There are two computing strategies:
- *
- * 1. using unordered_map or unordered_set do DO NOT alloc memory for each pixel/voxel (especially
- *    voxels) because most of them are not populated. This is memory efficient for large datasets and
- *    tiny resolutions where the number of voxels would be huge.
- * 2. using a bitset of a std::vector. ALL pixels/voxels are allocated. This is much faster (because of the
- *    cost of the hash map mainly) but may require to alloc a lot of memory.
+ * The registries of pixels and voxels are VoxelMaps. Only the populated pixels/voxels are allocated,
+ * which matters for voxels at tiny resolutions where most of them are empty, and the flat hash table
+ * is almost as fast as a dense vector.
  */
 
 // POISSON SAMPLING
@@ -28,9 +22,7 @@ bool LASRsamplingpoisson::process(PointCloud*& las)
   double r_square = distance*distance;
   double res = distance; // Cell size for the grid
 
-  std::unordered_map<int, std::vector<PointXYZ>> uregistry;
-  std::vector<std::vector<PointXYZ>> vregistry;
-  bool use_vregistry = false;
+  VoxelMap<std::vector<PointXYZ>> registry;
 
   std::vector<int> index(las->npoints);
   std::iota(index.begin(), index.end(), 0);
@@ -50,16 +42,10 @@ bool LASRsamplingpoisson::process(PointCloud*& las)
   rymax = ROUNDANY(rymax + 0.5 * res, res);
   rzmax = ROUNDANY(rzmax + 0.5 * res, res);
 
-  size_t length = (rxmax - rxmin) / res;
-  size_t width  = (rymax - rymin) / res;
-  size_t height = (rzmax - rzmin) / res;
-  size_t nvoxels = length*width*height;
-
-  if (nvoxels < INT_MAX/sizeof(std::vector<PointXYZ>)) // Cells numbers are stored has int
-  {
-    vregistry.resize(nvoxels);
-    use_vregistry = true;
-  }
+  int64_t length = (rxmax - rxmin) / res;
+  int64_t width  = (rymax - rymin) / res;
+  int64_t height = (rzmax - rzmin) / res;
+  int64_t nvoxels = length*width*height;
 
   progress->reset();
   progress->set_prefix("Poisson disk sampling");
@@ -87,97 +73,45 @@ bool LASRsamplingpoisson::process(PointCloud*& las)
     int ny = std::floor((py - rymin) / res);
     int nz = std::floor((pz - rzmin) / res);
 
-    int vkey = nx + ny*length + nz*length*width;
-    // Do we retain this point? We will look into the 27 neighbors to find if it is not too close to an already inserted points
-    bool valid = true;
+    int64_t vkey = nx + ny*length + nz*length*width;
 
-    // Check the central voxel, this should be enough in most cases and allows to skip the 26 neighbors
-    // >>>>>
-    if (use_vregistry)
+    // Do we retain this point? We will look into the 27 neighbors to find if it is not too close to an already inserted points
+    auto too_close = [&](int64_t key)
     {
-      for (const auto& p : vregistry[vkey])
+      const std::vector<PointXYZ>* pts = registry.find(key);
+      if (pts == nullptr) return false;
+
+      for (const auto& p : *pts)
       {
         double dist_square = (px - p.x) * (px - p.x) +  (py - p.y) * (py - p.y) + (pz - p.z) * (pz - p.z);
-        if (dist_square < r_square)
-        {
-          valid = false;
-          break;
-        }
-      }
-    }
-    else
-    {
-      auto it = uregistry.find(vkey);
-      if (it != uregistry.end())
-      {
-        for (const auto& p : it->second)
-        {
-          double dist_square = (px - p.x) * (px - p.x) +  (py - p.y) * (py - p.y) + (pz - p.z) * (pz - p.z);
-          if (dist_square < r_square)
-          {
-            valid = false;
-            break;
-          }
-        }
+        if (dist_square < r_square) return true;
       }
-    }
-    // >>>>>
 
-    if (valid)
+      return false;
+    };
+
+    // Check the central voxel, this should be enough in most cases and allows to skip the 26 neighbors
+    bool valid = !too_close(vkey);
+
+    for (int dx = -1; dx <= 1 && valid; ++dx)
     {
-      for (int dx = -1; dx <= 1 && valid; ++dx)
+      for (int dy = -1; dy <= 1 && valid; ++dy)
       {
-        for (int dy = -1; dy <= 1 && valid; ++dy)
+        for (int dz = -1; dz <= 1 && valid; ++dz)
         {
-          for (int dz = -1; dz <= 1; ++dz)
-          {
-            if (dx == 0 && dy == 0 && dz == 0) continue;
-
-            int key2 = (nx+dx) + (ny+dy)*length + (nz+dz)*length*width;
-            if (key2 < 0 || key2 >= (int)vregistry.size()) continue; // This happens at the edges where the voxels are not allocated
-
-            // If there are points the voxel
-            if (use_vregistry)
-            {
-              for (const auto& p : vregistry[key2])
-              {
-                double dist_square = (px - p.x) * (px - p.x) +  (py - p.y) * (py - p.y) + (pz - p.z) * (pz - p.z);
-                if (dist_square < r_square)
-                {
-                  valid = false;
-                  break;
-                }
-              }
-            }
-            else
-            {
-              auto it = uregistry.find(vkey);
-              if (it != uregistry.end())
-              {
-                for (const auto& p : it->second)
-                {
-                  double dist_square = (px - p.x) * (px - p.x) +  (py - p.y) * (py - p.y) + (pz - p.z) * (pz - p.z);
-                  if (dist_square < r_square)
-                  {
-                    valid = false;
-                    goto insert;
-                  }
-                }
-              }
-            }
-          }
+          if (dx == 0 && dy == 0 && dz == 0) continue;
+
+          int64_t key2 = (nx+dx) + (ny+dy)*length + (nz+dz)*length*width;
+          if (key2 < 0 || key2 >= nvoxels) continue; // This happens at the edges
+
+          valid = !too_close(key2);
         }
       }
     }
 
-    insert:
-
     if (valid)
     {
-      if (use_vregistry)
-        vregistry[vkey].emplace_back(px, py, pz);
-      else
-        uregistry[vkey].emplace_back(px, py, pz);
+      registry[vkey].emplace_back(px, py, pz);
 
       n++;
     }
@@ -211,9 +145,7 @@ bool LASRsamplingvoxels::set_parameters(const nlohmann::json& stage)
 
 bool LASRsamplingvoxels::process(PointCloud*& las)
 {
-  std::unordered_set<int> uregistry;
-  std::vector<bool> bitregistry;
-  bool use_bitregistry = false;
+  VoxelMap<char> registry;
 
   std::vector<int> index(las->npoints);
   std::iota(index.begin(), index.end(), 0);
@@ -224,25 +156,15 @@ bool LASRsamplingvoxels::process(PointCloud*& las)
   double rzmin = las->header->min_z;
   double rxmax = las->header->max_x;
   double rymax = las->header->max_y;
-  double rzmax = las->header->max_z;
 
   rxmin = ROUNDANY(rxmin - 0.5 * res, res);
   rymin = ROUNDANY(rymin - 0.5 * res, res);
   rzmin = ROUNDANY(rzmin - 0.5 * res, res);
   rxmax = ROUNDANY(rxmax + 0.5 * res, res);
   rymax = ROUNDANY(rymax + 0.5 * res, res);
-  rzmax = ROUNDANY(rzmax + 0.5 * res, res);
 
-  int length = (rxmax - rxmin)/res;
-  int width  = (rymax - rymin)/res;
-  int height = (rzmax - rzmin)/res;
-
-  size_t nvoxels = (size_t)length*(size_t)width*(size_t)height;
-  if (nvoxels < INT_MAX) // Cells numbers are stored has int
-  {
-    bitregistry.resize(nvoxels);
-    use_bitregistry = true;
-  }
+  int64_t length = (rxmax - rxmin)/res;
+  int64_t width  = (rymax - rymin)/res;
 
   progress->reset();
   progress->set_prefix("voxel sampling");
@@ -264,28 +186,13 @@ bool LASRsamplingvoxels::process(PointCloud*& las)
     int nx = std::floor((las->point.get_x() - rxmin) / res);
     int ny = std::floor((las->point.get_y() - rymin) / res);
     int nz = std::floor((las->point.get_z() - rzmin) / res);
-    int key = nx + ny*length + nz*length*width;
+    int64_t key = nx + ny*length + nz*length*width;
 
     // Do we retain this point ? We look into the registry to know if the voxel exist. If not, we retain the point.
-    if (use_bitregistry)
-    {
-      if (!bitregistry[key])
-      {
-        bitregistry[key] = true;
-        n++;
-      }
-      else
-      {
-        las->delete_point();
-      }
-    }
+    if (registry.insert(key))
+      n++;
     else
-    {
-      if (uregistry.insert(key).second)
-        n++;
-      else
-        las->delete_point();
-    }
+      las->delete_point();
 
     (*progress)++;
     progress->show();
@@ -329,9 +236,7 @@ bool LASRsamplingpixels::process(PointCloud*& las)
 
 bool LASRsamplingpixels::random(PointCloud*& las)
 {
-  std::unordered_set<int> uregistry;
-  std::vector<bool> bitregistry;
-  bool use_bitregistry = false;
+  VoxelMap<char> registry;
 
   std::vector<int> index(las->npoints);
   std::iota(index.begin(), index.end(), 0);
@@ -343,13 +248,6 @@ bool LASRsamplingpixels::random(PointCloud*& las)
   double rymax = las->header->max_y;
   Grid grid(rxmin, rymin, rxmax, rymax, res);
 
-  size_t npixels = grid.get_ncells();
-  if (npixels < INT_MAX) // Cells numbers are stored has int
-  {
-    bitregistry.resize(npixels);
-    use_bitregistry = true;
-  }
-
   progress->reset();
   progress->set_prefix("pixel sampling");
   progress->set_total(index.size());
@@ -365,25 +263,10 @@ bool LASRsamplingpixels::random(PointCloud*& las)
     int key = grid.cell_from_xy(las->point.get_x(), las->point.get_y());
 
     // Do we retain this point ? We look into the registry to know if the pixel exist. If not, we retain the point.
-    if (use_bitregistry)
-    {
-      if (!bitregistry[key])
-      {
-        bitregistry[key] = true;
-        n++;
-      }
-      else
-      {
-        las->delete_point();
-      }
-    }
+    if (registry.insert(key))
+      n++;
     else
-    {
-      if (uregistry.insert(key).second)
-        n++;
-      else
-        las->delete_point();
-    }
+      las->delete_point();
 
     (*progress)++;
     progress->show();
@@ -404,7 +287,8 @@ bool LASRsamplingpixels::highest(PointCloud*& las, bool high)
 {
   int n = las->npoints;
 
-  std::vector<std::pair<int, double>> registry;
+  // Index and value of the highest (or lowest) point of each pixel
+  VoxelMap<std::pair<int, double>> registry;
 
   double rxmin = las->header->min_x;
   double rymin = las->header->min_y;
@@ -412,21 +296,7 @@ bool LASRsamplingpixels::highest(PointCloud*& las, bool high)
   double rymax = las->header->max_y;
   Grid grid(rxmin, rymin, rxmax, rymax, res);
 
-  size_t npixels = grid.get_ncells();
-  if (npixels < INT_MAX) // Cells numbers are stored has int
-  {
-    registry.resize(npixels);
-
-    if (high)
-      std::fill(registry.begin(), registry.end(), std::make_pair(0, -std::numeric_limits<double>::infinity()));
-    else
-      std::fill(registry.begin(), registry.end(), std::make_pair(0, std::numeric_limits<double>::infinity()));
-  }
-  else
-  {
-    last_error = "Too many cells";
-    return false;
-  }
+  double none = (high) ? -std::numeric_limits<double>::infinity() : std::numeric_limits<double>::infinity();
 
   AttributeAccessor accessor(use_attribute);
 
@@ -439,8 +309,11 @@ bool LASRsamplingpixels::highest(PointCloud*& las, bool high)
     double z = accessor(&las->point);
     int cell = grid.cell_from_xy(x,y);
 
-    if ((high && registry[cell].second < z) || (!high && registry[cell].second > z))
-      registry[cell] = {las->current_point, z};
+    std::pair<int, double>* best = registry.find(cell);
+    if (best == nullptr) best = &(registry[cell] = {0, none});
+
+    if ((high && best->second < z) || (!high && best->second > z))
+      *best = {(int)las->current_point, z};
   }
 
   while (las->read_point())
@@ -451,7 +324,7 @@ bool LASRsamplingpixels::highest(PointCloud*& las, bool high)
     double y = las->point.get_y();
     int cell = grid.cell_from_xy(x,y);
 
-    if (registry[cell].first != las->current_point)
+    if (registry[cell].first != (int)las->current_point)
       las->point.set_deleted();
   }
 
@@ -0,0 +1,273 @@
+#include "smrf.h"
+#include "openmp.h"
+
+#include <limits>
+#include <algorithm>
+
+bool LASRsmrf::process(PointCloud*& las)
+{
+  progress->reset();
+  progress->set_prefix("SMRF");
+  progress->show();
+
+  // Minimum elevation surface
+  Raster zmin(las->header->min_x, las->header->min_y, las->header->max_x, las->header->max_y, res);
+  zmin.set_value(0, zmin.get_nodata());
+
+  Point p;
+  p.set_schema(&las->header->schema);
+  for (size_t i = 0 ; i < las->npoints ; i++)
+  {
+    if (!las->get_point(i, &p, &pointfilter)) continue;
+
+    int cell = zmin.cell_from_xy(p.get_x(), p.get_y());
+    if (cell < 0) continue;
+
+    float z = p.get_z();
+    float val = zmin.get_value(cell);
+    if (zmin.is_na(val) || z < val) zmin.set_value(cell, z);
+  }
+
+  int ncells = zmin.get_ncells();
+
+  // Progressive opening. The opening of the surface by a window of radius r is the erosion (min)
+  // followed by the dilation (max). Each window is applied to the surface opened by the previous one.
+  Raster surface(zmin);
+  if (!surface.copy_data(zmin)) return false;
+  fill_empty_cells(surface);
+
+  std::vector<float> before = surface.get_data();
+  std::vector<float> after(ncells);
+  std::vector<char> object(ncells, 0);
+  int nwindows = std::ceil(max_window/res);
+
+  progress->set_total(nwindows);
+
+  for (int r = 1 ; r <= nwindows ; r++)
+  {
+    opening(before, after, zmin.get_nrows(), zmin.get_ncols(), r);
+
+    double threshold = slope*r*res;
+    for (int cell = 0 ; cell < ncells ; cell++)
+    {
+      if (before[cell] - after[cell] > threshold) object[cell] = 1;
+    }
+
+    std::swap(before, after);
+
+    progress->update(r);
+    if (progress->interrupted()) return true;
+  }
+
+  // Provisional DTM made of the cells that are not objects
+  Raster dtm(zmin);
+  if (!dtm.copy_data(zmin)) return false;
+  for (int cell = 0 ; cell < ncells ; cell++)
+  {
+    if (object[cell]) dtm.set_value(cell, dtm.get_nodata());
+  }
+  fill_empty_cells(dtm);
+
+  // Slope of the DTM with central differences (one-sided on the edges)
+  int nrows = dtm.get_nrows();
+  int ncols = dtm.get_ncols();
+  const std::vector<float>& z = dtm.get_data();
+  std::vector<float> gradient(ncells, 0);
+
+  parallel_for(nrows, ncpu, [&](int64_t row)
+  {
+    int r0 = std::max<int>(row-1, 0);
+    int r1 = std::min<int>(row+1, nrows-1);
+    for (int col = 0 ; col < ncols ; col++)
+    {
+      int c0 = std::max(col-1, 0);
+      int c1 = std::min(col+1, ncols-1);
+      double dx = (c1 > c0) ? (z[row*ncols+c1] - z[row*ncols+c0]) / ((c1-c0)*res) : 0;
+      double dy = (r1 > r0) ? (z[r1*ncols+col] - z[r0*ncols+col]) / ((r1-r0)*res) : 0;
+      gradient[row*ncols+col] = std::sqrt(dx*dx + dy*dy);
+    }
+  });
+
+  // Points close enough to the DTM are ground. The tolerance increases with the slope.
+  // -1: excluded by the filter or no DTM, 0: non ground, 1: ground
+  std::vector<char> ground(las->npoints, -1);
+
+  parallel_for(las->npoints, ncpu, [&](int64_t i)
+  {
+    Point pp;
+    pp.set_schema(&las->header->schema);
+    if (!las->get_point(i, &pp, &pointfilter)) return;
+
+    double x = pp.get_x();
+    double y = pp.get_y();
+    int cell = dtm.cell_from_xy(x, y);
+    if (cell < 0) return;
+
+    float zdtm = dtm.get_value_bilinear(x, y);
+    if (dtm.is_na(zdtm)) return;
+
+    double tolerance = elevation_threshold + elevation_scaler*gradient[cell];
+    ground[i] = std::abs(pp.get_z() - zdtm) <= tolerance;
+  });
+
+  AttributeAccessor set_and_get_classification("Classification");
+
+  for (size_t i = 0 ; i < las->npoints ; i++)
+  {
+    if (ground[i] < 0) continue;
+
+    las->get_point(i, &p);
+    double c = set_and_get_classification(&p);
+
+    if (ground[i])
+    {
+      if (c != 9) set_and_get_classification(&p, classification);
+    }
+    else if (c == (double)classification)
+    {
+      set_and_get_classification(&p, 0);
+    }
+  }
+
+  progress->done();
+
+  return true;
+}
+
+// Running min or max of half-width h along a line of n values spaced by 'stride' (van Herk/Gil-Werman).
+// The line is padded with h neutral values on each side and split in blocks of 2h+1 values. The
+// extremum of a window is the extremum of a suffix of a block and of a prefix of the next one so
+// the cost does not depend on the size of the window.
+static void running_extremum(const float* in, float* out, int n, int stride, int h, bool max, std::vector<float>& fwd, std::vector<float>& bwd)
+{
+  auto op = [max](float a, float b) { return (max) ? std::max(a,b) : std::min(a,b); };
+  const float none = (max) ? -std::numeric_limits<float>::infinity() : std::numeric_limits<float>::infinity();
+
+  int k = 2*h+1;
+  int m = n + 2*h;
+  fwd.resize(m);
+  bwd.resize(m);
+
+  for (int i = 0 ; i < m ; i++)
+  {
+    int j = i - h;
+    float val = (j >= 0 && j < n) ? in[(size_t)j*stride] : none;
+    fwd[i] = (i % k == 0) ? val : op(fwd[i-1], val);
+  }
+
+  for (int i = m-1 ; i >= 0 ; i--)
+  {
+    int j = i - h;
+    float val = (j >= 0 && j < n) ? in[(size_t)j*stride] : none;
+    bwd[i] = (i == m-1 || (i+1) % k == 0) ? val : op(bwd[i+1], val);
+  }
+
+  for (int j = 0 ; j < n ; j++)
+    out[(size_t)j*stride] = op(bwd[j], fwd[j+k-1]);
+}
+
+// Opening by a square window of half-width r. The erosion and the dilation are separable: they are
+// computed along the rows and then along the columns.
+void LASRsmrf::opening(const std::vector<float>& in, std::vector<float>& out, int nrows, int ncols, int r) const
+{
+  std::vector<float> tmp(in.size());
+
+  for (bool max : {false, true})
+  {
+    const float* src = (max) ? out.data() : in.data();
+
+    parallel_for(nrows, ncpu, [&, fwd = std::vector<float>(), bwd = std::vector<float>()](int64_t row) mutable
+    {
+      running_extremum(src + row*ncols, tmp.data() + row*ncols, ncols, 1, r, max, fwd, bwd);
+    });
+
+    parallel_for(ncols, ncpu, [&, fwd = std::vector<float>(), bwd = std::vector<float>()](int64_t col) mutable
+    {
+      running_extremum(tmp.data() + col, out.data() + col, nrows, ncols, r, max, fwd, bwd);
+    });
+  }
+}
+
+// Empty cells are filled with the average of their non empty neighbours. The fill progresses
+// inward from the edges of the holes one ring per pass.
+void LASRsmrf::fill_empty_cells(Raster& raster) const
+{
+  int nrows = raster.get_nrows();
+  int ncols = raster.get_ncols();
+  std::vector<float> values = raster.get_data();
+
+  std::vector<int> empty;
+  for (int cell = 0 ; cell < raster.get_ncells() ; cell++)
+  {
+    if (raster.is_na(values[cell])) empty.push_back(cell);
+  }
+
+  std::vector<float> filled;
+  while (!empty.empty())
+  {
+    filled.resize(empty.size());
+
+    parallel_for(empty.size(), ncpu, [&](int64_t k)
+    {
+      int row = empty[k] / ncols;
+      int col = empty[k] % ncols;
+
+      double sum = 0;
+      int n = 0;
+      for (int r = std::max(row-1, 0) ; r <= std::min(row+1, nrows-1) ; r++)
+      {
+        for (int c = std::max(col-1, 0) ; c <= std::min(col+1, ncols-1) ; c++)
+        {
+          float val = values[r*ncols+c];
+          if (raster.is_na(val)) continue;
+          sum += val;
+          n++;
+        }
+      }
+
+      filled[k] = (n > 0) ? sum/n : raster.get_nodata();
+    });
+
+    size_t m = 0;
+    for (size_t k = 0 ; k < empty.size() ; k++)
+    {
+      if (raster.is_na(filled[k]))
+        empty[m++] = empty[k];
+      else
+        values[empty[k]] = filled[k];
+    }
+
+    // Nothing to propagate from: the raster is entirely empty
+    if (m == empty.size()) break;
+    empty.resize(m);
+  }
+
+  for (int cell = 0 ; cell < raster.get_ncells() ; cell++)
+  {
+    raster.set_value(cell, values[cell]);
+  }
+}
+
+bool LASRsmrf::set_parameters(const nlohmann::json& stage)
+{
+  res = stage.value("res", 1.0);
+  slope = stage.value("slope", 0.15);
+  max_window = stage.value("max_window", 18.0);
+  elevation_threshold = stage.value("elevation_threshold", 0.5);
+  elevation_scaler = stage.value("elevation_scaler", 1.25);
+  classification = stage.value("class", 2);
+
+  if (res <= 0)
+  {
+    last_error = "res must be positive";
+    return false;
+  }
+
+  if (max_window < res)
+  {
+    last_error = "max_window must be greater than res";
+    return false;
+  }
+
+  return true;
+}
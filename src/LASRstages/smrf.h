@@ -0,0 +1,36 @@
+#ifndef SMRF_H
+#define SMRF_H
+
+#include "Stage.h"
+
+// Simple Morphological Filter (Pingel et al. 2013). The lowest points are rasterized, the empty
+// cells are filled and the surface is opened with square windows of increasing radius. A cell
+// whose elevation drops by more than slope * radius during an opening is an object. The cells
+// that are not objects give a provisional DTM and the points close enough to this DTM are ground.
+class LASRsmrf: public Stage
+{
+public:
+  LASRsmrf() = default;
+  bool process(PointCloud*& las) override;
+  double need_buffer() const override { return max_window; };
+  bool is_parallelized() const override { return true; };
+  bool set_parameters(const nlohmann::json&) override;
+  std::string get_name() const override { return "smrf"; };
+
+  // multi-threading
+  LASRsmrf* clone() const override { return new LASRsmrf(*this); };
+
+private:
+  void opening(const std::vector<float>& in, std::vector<float>& out, int nrows, int ncols, int r) const;
+  void fill_empty_cells(Raster& raster) const;
+
+private:
+  double res;
+  double slope;
+  double max_window;
+  double elevation_threshold;
+  double elevation_scaler;
+  int classification;
+};
+
+#endif
@@ -1,6 +1,18 @@
 #include "sor.h"
-#include "Grid.h"
-
+#include "openmp.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+// The mean distance to the k nearest neighbours is computed for every point in a first pass and the
+// statistics are computed in a second pass.
+// 1. The coordinates are copied and sorted by cell of a grid whose cells are about the size of a
+//    k-neighbourhood so the candidates of the points of a cell are a few contiguous ranges of memory.
+//    The cells are processed in parallel. The rings of cells around the cell of a point are visited
+//    until the k-th neighbour is closer than the visited rings so the neighbours are exact.
+// 2. The mean and the variance are accumulated per block of points and the blocks are merged in
+//    order so the result does not depend on the number of cores.
 bool LASRsor::process(PointCloud*& las)
 {
   progress->reset();
@@ -8,43 +20,173 @@ bool LASRsor::process(PointCloud*& las)
   progress->set_prefix("Statistical outlier");
   progress->set_ncpu(ncpu);
 
-  int n = 0; // online variance
-  double m0 = 0.0; // online mean
-  double m2 = 0.0;
-  std::vector<double> distances;
-  distances.reserve(las->npoints);
+  Point p;
+  p.set_schema(&las->header->schema);
 
-  #pragma omp parallel for num_threads(ncpu)
-  for (unsigned int i = 0 ; i < las->npoints ; i++)
+  std::vector<size_t> ids;
+  ids.reserve(las->npoints);
+  double xmin = std::numeric_limits<double>::max();
+  double ymin = std::numeric_limits<double>::max();
+  double xmax = std::numeric_limits<double>::lowest();
+  double ymax = std::numeric_limits<double>::lowest();
+  for (size_t i = 0 ; i < las->npoints ; i++)
   {
-    (*progress)++;
-    if (progress->interrupted()) continue;
+    if (!las->get_point(i, &p)) continue;
+    ids.push_back(i);
+    xmin = std::min(xmin, p.get_x());
+    ymin = std::min(ymin, p.get_y());
+    xmax = std::max(xmax, p.get_x());
+    ymax = std::max(ymax, p.get_y());
+  }
 
-    Point p;
-    p.set_schema(&las->header->schema);
+  size_t n = ids.size();
+  if (n == 0) return true;
 
-    if (!las->get_point(i, &p)) continue;
+  // Grid of the size of the expected neighbourhood. There are never much more cells than points.
+  double density = n / ((xmax-xmin)*(ymax-ymin));
+  double res = std::sqrt((double)(k+1) / (density * 3.14)) * 1.5;
+  if (!std::isfinite(res) || res <= 0) res = std::max(std::max(xmax-xmin, ymax-ymin), 1.0);
+
+  int ncols, nrows;
+  for (;;)
+  {
+    ncols = (int)std::floor((xmax-xmin)/res) + 1;
+    nrows = (int)std::floor((ymax-ymin)/res) + 1;
+    if ((size_t)ncols*(size_t)nrows <= 4*n+1) break;
+    res *= 2;
+  }
+  size_t ncells = (size_t)ncols*(size_t)nrows;
+
+  // Counting sort of the points by cell
+  std::vector<int> cells(n);
+  std::vector<size_t> start(ncells+1, 0);
+  for (size_t j = 0 ; j < n ; j++)
+  {
+    las->get_point(ids[j], &p);
+    int col = std::min((int)((p.get_x()-xmin)/res), ncols-1);
+    int row = std::min((int)((p.get_y()-ymin)/res), nrows-1);
+    cells[j] = row*ncols + col;
+    start[cells[j]+1]++;
+  }
+  for (size_t c = 0 ; c < ncells ; c++) start[c+1] += start[c];
 
-    std::vector<Point> pts;
-    las->knn(p, k+1, std::numeric_limits<double>::max(), pts, &pointfilter);
+  std::vector<double> xs(n), ys(n), zs(n);
+  std::vector<size_t> sids(n);
+  std::vector<size_t> pos(start.begin(), start.end()-1);
+  for (size_t j = 0 ; j < n ; j++)
+  {
+    las->get_point(ids[j], &p);
+    size_t a = pos[cells[j]]++;
+    xs[a] = p.get_x();
+    ys[a] = p.get_y();
+    zs[a] = p.get_z();
+    sids[a] = ids[j];
+  }
+  cells.clear();
+  cells.shrink_to_fit();
+  ids.clear();
+  ids.shrink_to_fit();
 
-    double dsum = 0;
-    for (size_t i = 1; i < pts.size(); ++i) dsum += std::sqrt(std::pow(p.get_x() - pts[i].get_x(), 2) + std::pow(p.get_y() - pts[i].get_y(), 2) + std::pow(p.get_z() - pts[i].get_z(), 2));
-    double dmean =  dsum / (pts.size()-1);
-    distances[i] = dmean;
+  // The point itself is its first neighbour
+  int nk = (int)std::min<size_t>(k+1, n);
+  int rmax = std::max(ncols, nrows);
 
-    #pragma omp critical (sor)
+  std::vector<double> distances(las->npoints, std::numeric_limits<double>::quiet_NaN());
+
+  parallel_for(ncells, ncpu, [&, best = std::vector<double>()](int64_t c) mutable
+  {
+    int row = c / ncols;
+    int col = c % ncols;
+
+    for (size_t a = start[c] ; a < start[c+1] ; a++)
     {
-      // Average distance and variance
-      n++;
-      double delta = dmean - m0;
-      m0 += delta/n;
-      m2 += delta*(dmean - m0);
+      double x = xs[a];
+      double y = ys[a];
+      double z = zs[a];
+
+      // Squared distances of the nk nearest points visited so far in increasing order
+      best.clear();
+
+      for (int r = 0 ; r <= rmax ; r++)
+      {
+        for (int dr = -r ; dr <= r ; dr++)
+        {
+          int rr = row + dr;
+          if (rr < 0 || rr >= nrows) continue;
+
+          // The ring at distance r: every column of the first and last rows, the two ends otherwise
+          int step = (dr == -r || dr == r) ? 1 : 2*r;
+          for (int dc = -r ; dc <= r ; dc += step)
+          {
+            int cc = col + dc;
+            if (cc < 0 || cc >= ncols) continue;
+
+            size_t cell = (size_t)rr*ncols + cc;
+            for (size_t b = start[cell] ; b < start[cell+1] ; b++)
+            {
+              double dx = x - xs[b];
+              double dy = y - ys[b];
+              double dz = z - zs[b];
+              double d = std::pow(dx, 2) + std::pow(dy, 2) + std::pow(dz, 2);
+
+              if ((int)best.size() == nk)
+              {
+                if (d >= best.back()) continue;
+                best.pop_back();
+              }
+              best.insert(std::upper_bound(best.begin(), best.end(), d), d);
+            }
+          }
+        }
+
+        // Every point closer than r*res horizontally has been visited
+        if ((int)best.size() == nk && best.back() <= std::pow(r*res, 2)) break;
+      }
+
+      double dsum = 0;
+      for (int i = 1 ; i < nk ; i++) dsum += std::sqrt(best[i]);
+      distances[sids[a]] = dsum / (nk-1);
+
+      (*progress)++;
     }
+  });
+
+  if (progress->interrupted()) return true;
+
+  // Mean and variance (Welford) per block of points merged in order (Chan et al.)
+  struct Moments { double n = 0; double mean = 0; double m2 = 0; };
+  const size_t block = 65536;
+  size_t nblocks = (las->npoints + block - 1) / block;
+  std::vector<Moments> moments(nblocks);
+
+  parallel_for(nblocks, ncpu, [&](int64_t b)
+  {
+    Moments& mo = moments[b];
+    size_t end = std::min<size_t>((b+1)*block, las->npoints);
+    for (size_t i = b*block ; i < end ; i++)
+    {
+      double d = distances[i];
+      if (std::isnan(d)) continue;
+      mo.n++;
+      double delta = d - mo.mean;
+      mo.mean += delta/mo.n;
+      mo.m2 += delta*(d - mo.mean);
+    }
+  });
+
+  Moments total;
+  for (const auto& mo : moments)
+  {
+    if (mo.n == 0) continue;
+    double nn = total.n + mo.n;
+    double delta = mo.mean - total.mean;
+    total.mean += delta*mo.n/nn;
+    total.m2 += mo.m2 + delta*delta*total.n*mo.n/nn;
+    total.n = nn;
   }
 
-  double dmean = m0;
-  double dstd = std::sqrt(m2/(n-1));
+  double dmean = total.mean;
+  double dstd = std::sqrt(total.m2/(total.n-1));
 
   AttributeAccessor set_classification("Classification");
 
@@ -1,5 +1,6 @@
 #include "summary.h"
 #include "openmp.h"
+#include "NA.h"
 
 #include <iterator>
 
@@ -24,7 +25,14 @@ bool LASRsummary::set_parameters(const nlohmann::json& stage)
   std::vector<std::string> metrics;
   if (stage.contains("metrics")) metrics = get_vector<std::string>(stage.at("metrics"));
 
-  if (!metrics_engine.parse(metrics, false)) return false;
+  if (!metrics_engine.parse(metrics)) return false;
+
+  // Streamable metrics are computed on the fly with the accumulators of a single cell
+  if (metrics_engine.is_streamable())
+  {
+    values.assign(metrics_engine.size(), NA_F32_RASTER);
+    metrics_engine.init_accumulators(1);
+  }
 
   return true;
 }
@@ -48,7 +56,18 @@ bool LASRsummary::process(Point*& p)
   (zhistogram.find(z) == zhistogram.end()) ?  zhistogram[z] = 1 : zhistogram[z]++;
   (ihistogram.find(i) == ihistogram.end()) ?  ihistogram[i] = 1 : ihistogram[i]++;
 
-  if (metrics_engine.active())  cloud.push_back(*p);
+  if (metrics_engine.active())
+  {
+    if (metrics_engine.is_streamable())
+    {
+      if (metrics_engine.need_accumulators()) metrics_engine.accumulate(0, p);
+      for (int i = 0 ; i < metrics_engine.size() ; i++) values[i] = metrics_engine.get_metric(i, values[i], p);
+    }
+    else
+    {
+      cloud.push_back(*p);
+    }
+  }
 
   return true;
 }
@@ -66,13 +85,13 @@ bool LASRsummary::process(PointCloud*& las)
     process(p);
   }
 
-  if (metrics_engine.active())
+  if (metrics_engine.active() && !metrics_engine.is_streamable())
   {
+    metrics_engine.get_metrics(cloud, values);
     for (int i = 0 ; i < metrics_engine.size() ; i++)
     {
       const std::string& name = metrics_engine.get_name(i);
-      float val = metrics_engine.get_metric(i, cloud);
-      metrics[name].push_back(val);
+      metrics[name].push_back(values[i]);
     }
 
     cloud.clear();
@@ -81,6 +100,25 @@ bool LASRsummary::process(PointCloud*& las)
   return true;
 }
 
+bool LASRsummary::write()
+{
+  // Streamable metrics are computed once all the points of the chunk have been processed
+  if (metrics_engine.active() && metrics_engine.is_streamable())
+  {
+    for (int i = 0 ; i < metrics_engine.size() ; i++)
+    {
+      const std::string& name = metrics_engine.get_name(i);
+      float val = metrics_engine.get_metric(i, 0, values[i]);
+      metrics[name].push_back(val);
+    }
+
+    values.assign(metrics_engine.size(), NA_F32_RASTER);
+    metrics_engine.init_accumulators(1);
+  }
+
+  return true;
+}
+
 void LASRsummary::merge(const Stage* other)
 {
   const LASRsummary* o = dynamic_cast<const LASRsummary*>(other);
@@ -14,7 +14,8 @@ public:
   LASRsummary();
   bool process(Point*& p) override;
   bool process(PointCloud*& las) override;
-  bool is_streamable() const override { return !metrics_engine.active(); }
+  bool write() override;
+  bool is_streamable() const override { return !metrics_engine.active() || metrics_engine.is_streamable(); }
   bool set_parameters(const nlohmann::json&) override;
   std::string get_name() const override { return "summary"; }
 
@@ -23,7 +24,7 @@ public:
   LASRsummary* clone() const override { return new LASRsummary(*this); };
   void merge(const Stage* other) override;
   void sort(const std::vector<int>& order) override;
-  void clear(bool) override { reset_accessors(); };
+  void clear(bool) override { reset_accessors(); metrics_engine.reset(); };
 
   #ifdef USING_R
   SEXP to_R() override;
@@ -55,7 +56,8 @@ private:
   std::map<std::string, std::vector<float>> metrics;
 
   MetricManager metrics_engine;
-  PointCollection cloud;
+  PointCollection cloud;           // non streamable metrics: points of the chunk
+  std::vector<float> values;       // metrics of the chunk (running values for streamable metrics)
 };
 
 #endif
@@ -161,15 +161,14 @@ bool LASRsvd::process(PointCloud*& las)
   // is not thread safe. We first check that we are in outer thread 0
   bool main_thread = omp_get_thread_num() == 0;
 
-  #pragma omp parallel for num_threads(ncpu)
-  for (size_t i = 0 ; i < las->npoints ; i++)
+  parallel_for(las->npoints, ncpu, [&](int64_t i)
   {
-    if (progress->interrupted()) continue;
+    if (progress->interrupted()) return;
 
     Point p;
     p.set_schema(&las->header->schema);
 
-    if (!las->get_point(i, &p)) continue;
+    if (!las->get_point(i, &p)) return;
 
     std::vector<Point> pts;
     if (mode == PURERADIUS)
@@ -277,7 +276,7 @@ bool LASRsvd::process(PointCloud*& las)
         progress->show();
       }
     }
-  }
+  });
 
   progress->done();
 
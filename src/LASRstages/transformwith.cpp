@@ -152,7 +152,7 @@ bool LASRtransformwith::process(PointCloud*& las)
 
     if (triangulation != nullptr)
     {
-      if (!triangulation->interpolate(hag, nullptr))
+      if (!triangulation->interpolate(hag))
         return false;
     }
     else if (rasterization != nullptr)
@@ -3,10 +3,14 @@
 #include "Shape.h"
 #include "openmp.h"
 #include "NA.h"
+#include "Delaunay.h"
+
+#include "delaunator/delaunator.hpp"
 
 #include "lastransform.hpp"
 
-#include "delaunator/delaunator.hpp"
+#include <cmath>
+#include <algorithm>
 
 LASRtriangulate::LASRtriangulate()
 {
@@ -53,19 +57,44 @@ bool LASRtriangulate::process(PointCloud*& las)
   // However 'interpolate' will handle the case and fail
   if (coords.size() < 3) return true;
 
-  d = new delaunator::Delaunator(coords);
+  d = new Delaunay(coords, ncpu);
 
   progress->done();
 
   return true;
 }
 
-bool LASRtriangulate::interpolate(std::vector<double>& res, const Raster* raster)
+bool LASRtriangulate::get_triangle(int64_t t, AttributeAccessor& accessor, PointXYZ& a, PointXYZ& b, PointXYZ& c) const
+{
+  int64_t i = 3*t;
+
+  Point A,B,C;
+  A.set_schema(&las->header->schema);
+  B.set_schema(&las->header->schema);
+  C.set_schema(&las->header->schema);
+
+  las->get_point(index_map[d->triangles[i]], &A);
+  las->get_point(index_map[d->triangles[i+1]], &B);
+  las->get_point(index_map[d->triangles[i+2]], &C);
+
+  a = PointXYZ(A.get_x(), A.get_y(), accessor(&A));
+  b = PointXYZ(B.get_x(), B.get_y(), accessor(&B));
+  c = PointXYZ(C.get_x(), C.get_y(), accessor(&C));
+
+  // Interpolate in this triangle if the longest edge fulfill requirements
+  if (trim == 0) return true;
+  TriangleXYZ triangle(a, b, c);
+  return (keep_large) ? triangle.square_max_edge_size() > trim : triangle.square_max_edge_size() < trim;
+}
+
+// Interpolation of the points of the point cloud. The spatial index gives the spans of point
+// indexes that may be in the bounding box of each triangle. They are walked in place and the value
+// is written straight at the index of the point.
+bool LASRtriangulate::interpolate(std::vector<double>& res)
 {
   AttributeAccessor accessor(use_attribute);
 
-  int n = (raster == nullptr) ? las->npoints : raster->get_ncells();
-  res.resize(n);
+  res.resize(las->npoints);
   std::fill(res.begin(), res.end(), NA_F64);
 
   if (d == nullptr) return true;
@@ -81,74 +110,35 @@ bool LASRtriangulate::interpolate(std::vector<double>& res, const Raster* raster
   // is not thread safe. We first check that we are in outer thread 0
   bool main_thread = omp_get_thread_num() == 0;
 
-  // 1. loop through the triangles, search the point inside triangle, interpolate
-  #pragma omp parallel for num_threads(ncpu)
-  for (unsigned int i = 0 ; i < d->triangles.size() ; i+=3)
+  parallel_for(d->triangles.size()/3, ncpu, [&, intervals = std::vector<Interval>()](int64_t t) mutable
   {
-    if (progress->interrupted()) continue;
-
-    int id;
-    Point A,B,C;
-    A.set_schema(&las->header->schema);
-    B.set_schema(&las->header->schema);
-    C.set_schema(&las->header->schema);
-
-    id = index_map[d->triangles[i]];
-    las->get_point(id, &A);
-
-    id = index_map[d->triangles[i+1]];
-    las->get_point(id, &B);
+    if (progress->interrupted()) return;
 
-    id = index_map[d->triangles[i+2]];
-    las->get_point(id, &C);
-
-    PointXYZ a(A.get_x(), A.get_y(), accessor(&A));
-    PointXYZ b(B.get_x(), B.get_y(), accessor(&B));
-    PointXYZ c(C.get_x(), C.get_y(), accessor(&C));
-
-    TriangleXYZ triangle(a, b, c);
-
-    // Interpolate in this triangle if the longest edge fulfill requirements
-    bool keep_triangle = (keep_large) ? triangle.square_max_edge_size() > trim : triangle.square_max_edge_size() < trim;
-    if (trim == 0 || keep_triangle)
+    PointXYZ a, b, c;
+    if (get_triangle(t, accessor, a, b, c))
     {
-      if (raster)
+      // Local coordinates centered on A to gain arithmetic precision
+      TriangleXYZ triangle(a, b, c);
+      TriangleEdges edges;
+      if (edges.init(PointXYZ(0, 0, a.z), PointXYZ(b.x - a.x, b.y - a.y, b.z), PointXYZ(c.x - a.x, c.y - a.y, c.z), std::sqrt(EPSILON)))
       {
-        // Generate the raster points in this triangle
-        double xres = raster->get_xres();
-        double yres = raster->get_yres();
-        double minx = ROUNDANY(triangle.xmin(), xres) - 0.5 * xres;
-        double miny = ROUNDANY(triangle.ymin(), yres) - 0.5 * yres;
-        double maxx = ROUNDANY(triangle.xmax(), xres) + 0.5 * xres;
-        double maxy = ROUNDANY(triangle.ymax(), yres) + 0.5 * yres;
-
-        for (double x = minx ; x <= maxx ; x += xres)
+        Point pt;
+        pt.set_schema(&las->header->schema);
+
+        las->query(&triangle, intervals);
+        for (const auto& interval : intervals)
         {
-          for (double y = miny ; y <= maxy ; y += yres)
+          for (int i = interval.start ; i <= interval.end ; i++)
           {
-            if (!triangle.contains({x,y})) continue;
+            if (!las->get_point(i, &pt)) continue;
+            if (!edges.contains(pt.get_x() - a.x, pt.get_y() - a.y)) continue;
 
-            PointXYZ p(x,y);
+            PointXYZ p(pt.get_x(), pt.get_y());
             triangle.linear_interpolation(p);
-
-            int cell = raster->cell_from_xy(x,y);
-            if (cell != -1) res[cell] = p.z;
+            res[i] = p.z;
           }
         }
       }
-      else
-      {
-        std::vector<Point> points;
-        las->query(&triangle, points);
-
-        for (auto& pt : points)
-        {
-          PointXYZ p(pt.get_x(), pt.get_y());
-          triangle.linear_interpolation(p);
-          int index = las->get_index(&pt);
-          res[index] = p.z;
-        }
-      }
     }
 
     if (main_thread)
@@ -160,24 +150,25 @@ bool LASRtriangulate::interpolate(std::vector<double>& res, const Raster* raster
         progress->show();
       }
     }
-  }
+  });
 
   progress->done();
 
   return true;
 }
 
-bool LASRtriangulate::contour(std::vector<Edge>& e) const
+// Interpolation of the cells of a raster. Each triangle is scan converted and the values are
+// written straight into the raster (see Raster::set_triangle).
+bool LASRtriangulate::interpolate(Raster& raster)
 {
-  // d is nullptr if the triangulation was not computed because we do not have enough points.
-  // In this case 'contour' should not fail
-  if (d == nullptr) return true; // # nocov
+  AttributeAccessor accessor(use_attribute);
 
-  std::unordered_set<Edge> edges;
+  if (d == nullptr) return true;
+  if (raster.get_ncells() == 0) return true; // Fix #40
 
   progress->reset();
-  progress->set_prefix("Delaunay contours");
   progress->set_total(d->triangles.size()/3);
+  progress->set_prefix("Interpolation");
   progress->set_ncpu(ncpu);
   progress->show();
 
@@ -185,43 +176,71 @@ bool LASRtriangulate::contour(std::vector<Edge>& e) const
   // is not thread safe. We first check that we are in outer thread 0
   bool main_thread = omp_get_thread_num() == 0;
 
-  #pragma omp parallel for num_threads(ncpu)
-  for (unsigned int i = 0 ; i < d->triangles.size() ; i+=3)
+  // Protect against data race. The first call initialize the memory and is not thread safe
+  raster.set_value(0, raster.get_nodata(), 1);
+
+  parallel_for(d->triangles.size()/3, ncpu, [&](int64_t t)
   {
-    if (progress->interrupted()) continue;
+    if (progress->interrupted()) return;
 
-    int id;
-    Point a, b, c;
-    a.set_schema(&las->header->schema);
-    b.set_schema(&las->header->schema);
-    c.set_schema(&las->header->schema);
+    PointXYZ a, b, c;
+    if (get_triangle(t, accessor, a, b, c))
+      raster.set_triangle(TriangleXYZ(a, b, c));
 
-    id = index_map[d->triangles[i]];
-    las->get_point(id, &a);
+    if (main_thread)
+    {
+      // can only be called in outer thread 0 AND is internally thread safe being called only in outer thread 0
+      #pragma omp critical
+      {
+        (*progress)++;
+        progress->show();
+      }
+    }
+  });
 
-    id = index_map[d->triangles[i+1]];
-    las->get_point(id, &b);
+  progress->done();
 
-    id = index_map[d->triangles[i+2]];
-    las->get_point(id, &c);
+  return true;
+}
 
-    TriangleXYZ triangle(a, b, c);
+// Boundaries of the triangulation once the triangles are trimmed. A halfedge is on a boundary if
+// its triangle is kept and its opposite halfedge is missing (convex hull) or belongs to a trimmed
+// triangle. From the end vertex of a boundary halfedge, the next one is found by turning around the
+// vertex through the kept triangles. The rings are thus walked in order, in O(n) and without
+// hashing. Delaunator triangles are clockwise so the rings are reversed to get counter-clockwise
+// outer rings and clockwise holes.
+bool LASRtriangulate::contour(std::vector<PolygonXY>& rings) const
+{
+  // d is nullptr if the triangulation was not computed because we do not have enough points.
+  // In this case 'contour' should not fail
+  if (d == nullptr) return true; // # nocov
 
-    bool keep_triangle = (keep_large) ? triangle.square_max_edge_size() > trim : triangle.square_max_edge_size() < trim;
-    if (trim == 0 || keep_triangle)
-    {
-      triangle.make_clock_wise();
+  const std::vector<size_t>& triangles = d->triangles;
+  const std::vector<size_t>& halfedges = d->halfedges;
+  size_t ntri = triangles.size()/3;
 
-      Edge AB = {triangle.A, triangle.B};
-      Edge BC = {triangle.B, triangle.C};
-      Edge CA = {triangle.C, triangle.A};
+  progress->reset();
+  progress->set_prefix("Delaunay contours");
+  progress->set_total(ntri);
+  progress->set_ncpu(ncpu);
+  progress->show();
 
-      #pragma omp critical
-      {
-        if (edges.count(AB) > 0) edges.erase(AB); else edges.insert(AB);
-        if (edges.count(BC) > 0) edges.erase(BC); else edges.insert(BC);
-        if (edges.count(CA) > 0) edges.erase(CA); else edges.insert(CA);
-      }
+  // The next for loop is at the level a nested parallel region. Printing the progress bar
+  // is not thread safe. We first check that we are in outer thread 0
+  bool main_thread = omp_get_thread_num() == 0;
+
+  std::vector<char> keep(ntri, 1);
+  parallel_for(ntri, ncpu, [&, a = Point(nullptr, &las->header->schema), b = Point(nullptr, &las->header->schema), c = Point(nullptr, &las->header->schema)](int64_t t) mutable
+  {
+    if (progress->interrupted()) return;
+
+    if (trim != 0)
+    {
+      las->get_point(index_map[triangles[3*t]], &a);
+      las->get_point(index_map[triangles[3*t+1]], &b);
+      las->get_point(index_map[triangles[3*t+2]], &c);
+      TriangleXYZ triangle(a, b, c);
+      keep[t] = (keep_large) ? triangle.square_max_edge_size() > trim : triangle.square_max_edge_size() < trim;
     }
 
     if (main_thread)
@@ -233,9 +252,47 @@ bool LASRtriangulate::contour(std::vector<Edge>& e) const
         progress->show();
       }
     }
-  }
+  });
+
+  std::vector<char> boundary(triangles.size(), 0);
+  parallel_for(ntri, ncpu, [&](int64_t t)
+  {
+    if (!keep[t]) return;
+    size_t e0 = 3*(size_t)t;
+    for (size_t e = e0 ; e < e0+3 ; e++)
+      boundary[e] = halfedges[e] == delaunator::INVALID_INDEX || !keep[halfedges[e]/3];
+  });
+
+  progress->done();
+
+  auto next_halfedge = [](size_t e) { return (e % 3 == 2) ? e - 2 : e + 1; };
 
-  for (const auto& elmt : edges) e.push_back(elmt);
+  Point pt;
+  pt.set_schema(&las->header->schema);
+
+  std::vector<char> visited(triangles.size(), 0);
+  for (size_t start = 0 ; start < triangles.size() ; start++)
+  {
+    if (!boundary[start] || visited[start]) continue;
+
+    PolygonXY ring;
+    size_t e = start;
+    do
+    {
+      visited[e] = 1;
+      las->get_point(index_map[triangles[e]], &pt);
+      ring.push_back(PointXY(pt.get_x(), pt.get_y()));
+
+      // Turn around the end vertex of e through the kept triangles up to the next boundary
+      size_t n = next_halfedge(e);
+      while (!boundary[n]) n = next_halfedge(halfedges[n]);
+      e = n;
+    } while (e != start);
+
+    std::reverse(ring.coordinates.begin(), ring.coordinates.end());
+    ring.close();
+    rings.push_back(std::move(ring));
+  }
 
   return true;
 }
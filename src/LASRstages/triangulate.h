@@ -5,22 +5,17 @@
 #include "Vector.h"
 #include "Shape.h"
 
-#include <unordered_set>
-
 class Raster;
-
-namespace delaunator
-{
-  class Delaunator;
-}
+class Delaunay;
 
 class LASRtriangulate : public StageVector
 {
 public:
   LASRtriangulate();
   bool process(PointCloud*& las) override;
-  bool interpolate(std::vector<double>& res, const Raster* raster = nullptr);
-  bool contour(std::vector<Edge>& edges) const;
+  bool interpolate(std::vector<double>& res);
+  bool interpolate(Raster& raster);
+  bool contour(std::vector<PolygonXY>& rings) const;
   double need_buffer() const override { return 20.0; }
   void clear(bool last) override;
   bool write() override;
@@ -31,6 +26,9 @@ public:
   bool is_parallelizable() const override { return true; };
   LASRtriangulate* clone() const override { return new LASRtriangulate(*this); };
 
+private:
+  bool get_triangle(int64_t t, AttributeAccessor& accessor, PointXYZ& a, PointXYZ& b, PointXYZ& c) const;
+
 private:
   bool keep_large;
   double trim;
@@ -38,7 +36,7 @@ private:
   std::vector<double> coords;
   std::vector<int> index_map;
   std::string use_attribute;
-  delaunator::Delaunator* d;
+  Delaunay* d;
   PointCloud* las;
 };
 
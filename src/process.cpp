@@ -209,93 +209,117 @@ bool process(const std::string& config_file)
 
     bool failure = false;
     int k = 0;
-
-    #pragma omp parallel num_threads(ncpu_outer_loop)
+    int next = 0;
+
+    // Chunks are processed by a pool of ncpu_outer_loop workers. Each worker is a task that owns a
+    // copy of the pipeline and pulls chunks until there are no more to process. The team contains
+    // the threads of all the workers and of their inner loops (ncpu_outer_loop x ncpu_inner_loops).
+    // The stages split their loops into tasks (see parallel_for()) that are executed by any idle
+    // thread of the team. This way, a thread that has no more chunks to process helps the chunks
+    // that are still running. Nesting is still enabled for the loops that open their own parallel
+    // region (e.g. Eigen) so they keep their ncpu_inner_loops threads.
+    int nthreads = (ncpu_outer_loop > 1) ? ncpu_outer_loop*ncpu_inner_loops : 1;
+
+    #pragma omp parallel num_threads(nthreads)
+    #pragma omp single
+    for (int worker = 0 ; worker < ncpu_outer_loop ; ++worker)
     {
-      try
+      #pragma omp task
       {
-        // We need a copy of the pipeline. The copy constructor of the pipeline and stages
-        // ensure that shared resources are protected (such as connection to output files)
-        // and private data are copied.
-        Pipeline private_pipeline(pipeline);
-
-        #pragma omp for schedule(dynamic)
-        for (int i = 0 ; i < n ; ++i)
+        try
         {
-          // We cannot exit a parallel loop easily. Instead we can rather run the loop until the end
-          // skipping the processing
-          if (failure) continue;
-          if (progress.interrupted()) continue;
-
-          // We query the chunk i (thread safe)
-          Chunk chunk;
-          if (!lascatalog->get_chunk(i, chunk))
-          {
-            failure = true;
-            continue;
-          }
+          // We need a copy of the pipeline. The copy constructor of the pipeline and stages
+          // ensure that shared resources are protected (such as connection to output files)
+          // and private data are copied.
+          Pipeline private_pipeline(pipeline);
 
-          if (verbose)
+          while (true)
           {
-            print("Processing chunk %d/%d in thread %d: %s\n", i+1, n, omp_get_thread_num(), chunk.name.c_str()); // # nocov
-          }
+            // We query the index of the next chunk to process
+            int i;
+            #pragma omp atomic capture
+            i = next++;
+
+            if (i >= n) break;
+
+            // We cannot exit the pool easily. Instead we can rather run the loop until the end
+            // skipping the processing
+            if (failure) continue;
+            if (progress.interrupted()) continue;
+
+            // We query the chunk i (thread safe)
+            Chunk chunk;
+            if (!lascatalog->get_chunk(i, chunk))
+            {
+              failure = true;
+              continue;
+            }
+
+            if (verbose)
+            {
+              print("Processing chunk %d/%d in thread %d: %s\n", i+1, n, omp_get_thread_num(), chunk.name.c_str()); // # nocov
+            }
+
+            // If the chunk is not flagged "process" it is a file that is only used as buffer
+            // we can skip the processing
+            if (!chunk.process)
+            {
+              #pragma omp critical
+              {
+                k++;
+                progress.update(k, true);
+                progress.show();
+                if (verbose) print("Chunk %d is flagged for not being processed. Skipped.", i);
+              }
+
+              continue;
+            }
+
+            // set_chunk() initialize the region we are working with which is a sub-part of the
+            // overall processed region
+            if (!private_pipeline.set_chunk(chunk))
+            {
+              failure = true;
+              continue;
+            }
+
+            // run() does execute the pipeline. This is encapsulated but at the end each stage
+            // is supposed to contains the data for the current chunk and optionally write the
+            // result into a file
+            if (!private_pipeline.run())
+            {
+              failure = true;
+              continue;
+            }
 
-          // If the chunk is not flagged "process" it is a file that is only used as buffer
-          // we can skip the processing
-          if (!chunk.process)
-          {
             #pragma omp critical
             {
               k++;
               progress.update(k, true);
               progress.show();
-              if (verbose) print("Chunk %d is flagged for not being processed. Skipped.", i);
             }
-
-            continue;
-          }
-
-          // set_chunk() initialize the region we are working with which is a sub-part of the
-          // overall processed region
-          if (!private_pipeline.set_chunk(chunk))
-          {
-            failure = true;
-            continue;
           }
 
-          // run() does execute the pipeline. This is encapsulated but at the end each stage
-          // is supposed to contains the data for the current chunk and optionally write the
-          // result into a file
-          if (!private_pipeline.run())
-          {
-            failure = true;
-            continue;
-          }
+          // We are outside the main loop. We can clear the pipeline with last = true;
+          private_pipeline.clear(true);
 
+          // We have multiple pipelines and each processed some chunks and each have a partial
+          // output. We reduce in the main pipeline. To preserve the ordering of the output we
+          // well call sort() outside the paraellel region
           #pragma omp critical
           {
-            k++;
-            progress.update(k, true);
-            progress.show();
+            pipeline.merge(private_pipeline);
           }
         }
-
-        // We are outside the main loop. We can clear the pipeline with last = true;
-        private_pipeline.clear(true);
-
-        // We have multiple pipelines and each processed some chunks and each have a partial
-        // output. We reduce in the main pipeline. To preserve the ordering of the output we
-        // well call sort() outside the paraellel region
-        #pragma omp critical
+        catch (std::string e)
         {
-          pipeline.merge(private_pipeline);
+          #pragma omp critical
+          {
+            last_error = e;
+          }
+          failure = true;
         }
       }
-      catch (std::string e)
-      {
-        last_error = e;
-        failure = true;
-      }
     }
 
     // We are no longer in the parallel region we can return to R by allocating safely